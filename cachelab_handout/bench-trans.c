@@ -0,0 +1,206 @@
+/*
+ * bench-trans.c - Wall-clock benchmark of the transposes on matrices far
+ *     larger than tracegen's, up to 16k x 16k ints.
+ *
+ * For every size from 1024 up to the maximum (doubling) it times the
+ * parallel transpose with one worker, which is the baseline, and with
+ * all of them, and the multi-threaded in-place transpose of a square
+ * matrix, and reports GB/s counting every element as read once and
+ * written once. The baseline runs the same tiles and kernels as the
+ * parallel run; trans_tiled is not used, as its tile_size degrades to
+ * single elements when N is a power of 2.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include "cachelab.h"
+
+/* Defined in trans.c */
+extern int trans_workers;
+extern void trans_parallel(int M, int N, int A[N][M], int B[M][N]);
+extern void transpose_inplace(int N, int A[N][N]);
+
+#define MIN_SIZE 1024
+#define MAX_SIZE 16384
+
+/* fill - the band of rows one thread initializes */
+typedef struct _fill {
+	int* A;
+	long long int n;
+	long long int row0, row1;
+} fill;
+
+static void* fill_rows(void* arg)
+{
+	fill* f = (fill*) arg;
+	long long int i, j;
+
+	for (i = f->row0; i < f->row1; i++) {
+		for (j = 0; j < f->n; j++) {
+			f->A[i * f->n + j] = (int)(i * f->n + j);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * init_matrix - Set A[i][j] = i * n + j with one thread per row band,
+ *     the same bands the parallel transposes start from, so that first
+ *     touch places each band's pages near the worker that reads them
+ */
+static void init_matrix(int* A, int n, int nthreads)
+{
+	pthread_t tids[64];
+	fill fills[64];
+	int started[64];
+	int i;
+
+	if (nthreads < 1) nthreads = 1;
+	for (i = 0; i < nthreads; i++) {
+		fills[i].A = A;
+		fills[i].n = n;
+		fills[i].row0 = (long long int) n * i / nthreads;
+		fills[i].row1 = (long long int) n * (i + 1) / nthreads;
+	}
+	for (i = 1; i < nthreads; i++) {
+		started[i] = pthread_create(&tids[i], NULL, fill_rows, &fills[i]) == 0;
+		if (!started[i]) {
+			fill_rows(&fills[i]);
+		}
+	}
+	fill_rows(&fills[0]);
+	for (i = 1; i < nthreads; i++) {
+		if (started[i]) {
+			pthread_join(tids[i], NULL);
+		}
+	}
+}
+
+/* check - Whether A holds the transpose of what init_matrix wrote */
+static int check(const int* A, int n)
+{
+	long long int i, j;
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			if (A[i * n + j] != (int)(j * n + i)) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char* name, int n, double sec, int ok)
+{
+	double bytes = 2.0 * sizeof(int) * n * n;
+
+	printf("%6d x %-6d %-22s %9.2f ms %8.2f GB/s%s\n", n, n, name,
+			sec * 1e3, bytes / sec * 1e-9, ok ? "" : "  INCORRECT");
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char* argv[])
+{
+	printf("Usage: %s [-h] [-n <size>] [-t <threads>] [-r <runs>]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h           Print this help message.\n");
+	printf("  -n <size>    Largest matrix side (default %d).\n", MAX_SIZE);
+	printf("  -t <threads> Workers of the parallel transposes (default: one per CPU).\n");
+	printf("  -r <runs>    Report the best of <runs> runs (default 3).\n");
+}
+
+int main(int argc, char* argv[])
+{
+	int opt, n, run, runs = 3, maxn = MAX_SIZE, nthreads, workers;
+	double start, sec, best;
+	int *A, *B;
+
+	while ((opt = getopt(argc, argv, "n:t:r:h")) != -1) {
+		switch (opt) {
+			case 'n': maxn = atoi(optarg);
+					  break;
+			case 't': trans_workers = atoi(optarg);
+					  break;
+			case 'r': runs = atoi(optarg);
+					  break;
+			case 'h': usage(argv);
+					  exit(0);
+			default: usage(argv);
+					 exit(1);
+		}
+	}
+	if (maxn < 8 || maxn > MAX_SIZE || runs < 1 || trans_workers < 0 || trans_workers > 64) {
+		usage(argv);
+		exit(1);
+	}
+	nthreads = trans_workers > 0 ? trans_workers : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > 64) nthreads = 64;
+	if (nthreads < 1) nthreads = 1;
+	workers = trans_workers;
+	printf("%d worker%s\n", nthreads, nthreads == 1 ? "" : "s");
+
+	for (n = maxn < MIN_SIZE ? maxn : MIN_SIZE; n <= maxn; n *= 2) {
+		size_t bytes = sizeof(int) * (size_t) n * (size_t) n;
+
+		A = (int*) malloc(bytes);
+		B = (int*) malloc(bytes);
+		if (A == NULL || B == NULL) {
+			printf("%6d x %-6d cannot allocate %zu MB\n", n, n, 2 * bytes >> 20);
+			free(A);
+			free(B);
+			break;
+		}
+		init_matrix(A, n, nthreads);
+		init_matrix(B, n, nthreads);
+
+		best = 1e30;
+		trans_workers = 1;
+		for (run = 0; run < runs; run++) {
+			start = now_sec();
+			trans_parallel(n, n, (int (*)[n]) A, (int (*)[n]) B);
+			sec = now_sec() - start;
+			if (sec < best) best = sec;
+		}
+		trans_workers = workers;
+		report("parallel, 1 worker", n, best, check(B, n));
+
+		best = 1e30;
+		for (run = 0; run < runs; run++) {
+			start = now_sec();
+			trans_parallel(n, n, (int (*)[n]) A, (int (*)[n]) B);
+			sec = now_sec() - start;
+			if (sec < best) best = sec;
+		}
+		report("parallel", n, best, check(B, n));
+
+		/* an odd number of in-place transposes leaves A transposed */
+		best = 1e30;
+		for (run = 0; run < (runs | 1); run++) {
+			start = now_sec();
+			transpose_inplace(n, (int (*)[n]) A);
+			sec = now_sec() - start;
+			if (sec < best) best = sec;
+		}
+		report("parallel in-place", n, best, check(A, n));
+
+		free(A);
+		free(B);
+	}
+	return 0;
+}
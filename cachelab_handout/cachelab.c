@@ -6,10 +6,14 @@
 #include <assert.h>
 #include "cachelab.h"
 #include <time.h>
+#include <string.h>
 
 trans_func_t func_list[MAX_TRANS_FUNCS];
 int func_counter = 0; 
 
+layout_func_t layout_list[MAX_LAYOUT_FUNCS];
+int layout_counter = 0;
+
 /* 
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded. 
@@ -81,3 +85,81 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
     func_list[func_counter].num_evictions =0;
     func_counter++;
 }
+
+/*
+ * initLayout - Fill the N x M matrix A of size-byte elements with
+ *     random bytes
+ */
+void initLayout(int M, int N, size_t size, void* A)
+{
+    unsigned char* bytes = (unsigned char*) A;
+    size_t i;
+
+    srand(time(NULL));
+    for (i = 0; i < (size_t) M * N * size; i++)
+        bytes[i] = rand();
+}
+
+/*
+ * correctLayout - Baseline layout conversions used to evaluate
+ *     correctness. The Morton layout walks every Z-order code of a
+ *     square power-of-2 grid of tiles and skips those off the matrix.
+ */
+void correctLayout(layout_kind kind, int M, int N, size_t size,
+                   const void* A, void* B)
+{
+    const unsigned char* a = (const unsigned char*) A;
+    unsigned char* b = (unsigned char*) B;
+    int i, j, t, rows, cols, side, bit;
+    int ti, tj, r, c;
+    long long int z, codes;
+
+    if (kind == LAYOUT_TRANSPOSE) {
+        for (i = 0; i < N; i++)
+            for (j = 0; j < M; j++)
+                memcpy(b + ((size_t) j * N + i) * size,
+                       a + ((size_t) i * M + j) * size, size);
+        return;
+    }
+
+    t = MORTON_TILE(size);
+    rows = (N + t - 1) / t;
+    cols = (M + t - 1) / t;
+    for (side = 1; side < rows || side < cols; side *= 2)
+        ;
+    codes = (long long int) side * side;
+    for (z = 0; z < codes; z++) {
+        /* Row bits are the odd bits of z and column bits the even ones */
+        ti = tj = 0;
+        for (bit = 0; (1LL << (2 * bit)) < codes; bit++) {
+            tj |= ((z >> (2 * bit)) & 1) << bit;
+            ti |= ((z >> (2 * bit + 1)) & 1) << bit;
+        }
+        if (ti >= rows || tj >= cols)
+            continue;
+        for (r = ti * t; r < (ti + 1) * t && r < N; r++)
+            for (c = tj * t; c < (tj + 1) * t && c < M; c++) {
+                memcpy(b, a + ((size_t) r * M + c) * size, size);
+                b += size;
+            }
+    }
+}
+
+/*
+ * registerLayoutFunction - Add the given layout function into your list
+ *     of layout functions to be tested
+ */
+void registerLayoutFunction(
+    void (*layout)(int M, int N, size_t size, const void* A, void* B),
+    char* desc, layout_kind kind, size_t elem_size)
+{
+    layout_list[layout_counter].func_ptr = layout;
+    layout_list[layout_counter].description = desc;
+    layout_list[layout_counter].kind = kind;
+    layout_list[layout_counter].elem_size = elem_size;
+    layout_list[layout_counter].correct = 0;
+    layout_list[layout_counter].num_hits = 0;
+    layout_list[layout_counter].num_misses = 0;
+    layout_list[layout_counter].num_evictions = 0;
+    layout_counter++;
+}
@@ -5,7 +5,19 @@
 #ifndef CACHELAB_TOOLS_H
 #define CACHELAB_TOOLS_H
 
+#include <stddef.h>
+
 #define MAX_TRANS_FUNCS 100
+#define MAX_LAYOUT_FUNCS 100
+
+/* Element sizes a layout function may be asked for: 1, 2, 4, 8 or 16 */
+#define MAX_ELEM_SIZE 16
+#define ELEM_SIZE_OK(size) ((size) >= 1 && (size) <= MAX_ELEM_SIZE && \
+                            ((size) & ((size) - 1)) == 0)
+
+/* Each Morton tile row is one 32-byte block: 32 / size elements square */
+#define MORTON_TILE_BYTES 32
+#define MORTON_TILE(size) (MORTON_TILE_BYTES / (size))
 
 typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
@@ -16,6 +28,29 @@ typedef struct trans_func{
   unsigned int num_evictions;
 } trans_func_t;
 
+/*
+ * What a layout function makes of A, N rows of M elements of a given
+ * size. An array of N records of M equal-sized fields is such an A,
+ * and its structure of arrays is the transpose, so AoS to SoA (and
+ * back) conversions are LAYOUT_TRANSPOSE functions.
+ */
+typedef enum {
+  LAYOUT_TRANSPOSE,  /* B = A^T, M rows of N elements */
+  LAYOUT_MORTON      /* B = A cut into MORTON_TILE(size) square tiles,
+                        each row-major, with the tiles in Z-order */
+} layout_kind;
+
+typedef struct layout_func{
+  void (*func_ptr)(int M,int N,size_t size,const void* A,void* B);
+  char* description;
+  layout_kind kind;
+  size_t elem_size; /* the only element size handled, or 0 for all */
+  char correct;
+  unsigned int num_hits;
+  unsigned int num_misses;
+  unsigned int num_evictions;
+} layout_func_t;
+
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
@@ -34,4 +69,17 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/* Fill A with random size-byte elements */
+void initLayout(int M, int N, size_t size, void* A);
+
+/* The baseline layout conversion that produces correct results */
+void correctLayout(layout_kind kind, int M, int N, size_t size,
+                   const void* A, void* B);
+
+/* Add the given layout function, of elements of elem_size bytes (0
+   for any size), to the layout function list */
+void registerLayoutFunction(
+    void (*layout)(int M,int N,size_t size,const void* A,void* B),
+    char* desc, layout_kind kind, size_t elem_size);
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,77 @@
+/*
+ * cachemodel.c - Small in-process cache model for the transpose tools
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "cachemodel.h"
+
+cache_model *new_cache_model(int s, int E, int b, const policy *pol)
+{
+	cache_model *m = (cache_model*) calloc(1, sizeof(cache_model));
+	int S = 1 << s, i;
+
+	m->s = s;
+	m->E = E;
+	m->b = b;
+	m->pol = pol;
+	m->tags = (unsigned long long int*) calloc((size_t) S * E, sizeof(unsigned long long int));
+	m->meta = (pset*) malloc(sizeof(pset) * S);
+	for (i = 0; i < S; i++) {
+		init_pset(&m->meta[i], E, i);
+	}
+	return m;
+}
+
+void reset_cache_model(cache_model *m)
+{
+	int S = 1 << m->s, i;
+
+	memset(m->tags, 0, sizeof(unsigned long long int) * S * m->E);
+	for (i = 0; i < S; i++) {
+		free_pset(&m->meta[i]);
+		init_pset(&m->meta[i], m->E, i);
+	}
+	m->hits = m->misses = m->evictions = 0;
+}
+
+int model_access(cache_model *m, unsigned long long int addr)
+{
+	unsigned long long int setindex = (addr >> m->b) & ((1ULL << m->s) - 1);
+	unsigned long long int tag = (addr >> (m->s + m->b)) + 1;
+	unsigned long long int *tags = m->tags + setindex * m->E;
+	pset *meta = &m->meta[setindex];
+	int way, empty = -1;
+
+	for (way = 0; way < m->E; way++) {
+		if (tags[way] == tag) {
+			m->hits++;
+			m->pol->hit(meta, way, m->E);
+			return 0;
+		}
+		if (tags[way] == 0 && empty == -1) {
+			empty = way;
+		}
+	}
+
+	m->misses++;
+	if (empty == -1) {
+		m->evictions++;
+		empty = m->pol->victim(meta, m->E);
+		m->pol->invalidate(meta, empty, m->E);
+	}
+	tags[empty] = tag;
+	m->pol->fill(meta, empty, m->E);
+	return 1;
+}
+
+void free_cache_model(cache_model *m)
+{
+	int S = 1 << m->s, i;
+
+	for (i = 0; i < S; i++) {
+		free_pset(&m->meta[i]);
+	}
+	free(m->meta);
+	free(m->tags);
+	free(m);
+}
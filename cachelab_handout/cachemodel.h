@@ -0,0 +1,39 @@
+/*
+ * cachemodel.h - Small in-process cache model for the transpose tools
+ *
+ * One level of 2^s sets of E lines with 2^b byte blocks, write-allocate
+ * like csim, so loads and stores count the same. Replacement uses the
+ * policies of policy.c. The tools call model_access() for every access
+ * instead of tracing a run with valgrind and replaying it through csim.
+ */
+
+#ifndef CSIM_CACHEMODEL_H
+#define CSIM_CACHEMODEL_H
+
+#include "policy.h"
+
+typedef struct _cache_model {
+	int s;
+	int E;
+	int b;
+	const policy *pol;
+	unsigned long long int *tags;	/* S * E tags + 1, 0 if the line is empty */
+	pset *meta;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions;
+} cache_model;
+
+/* new_cache_model - An empty cache; pol must support E ways */
+cache_model *new_cache_model(int s, int E, int b, const policy *pol);
+
+/* reset_cache_model - Empty the cache and clear the counters */
+void reset_cache_model(cache_model *m);
+
+/* model_access - Access the byte at addr. Returns 1 on a miss. */
+int model_access(cache_model *m, unsigned long long int addr);
+
+/* free_cache_model - Release everything held by m */
+void free_cache_model(cache_model *m);
+
+#endif /* CSIM_CACHEMODEL_H */
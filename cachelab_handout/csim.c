@@ -1,156 +1,876 @@
 // 2017-16140
+#define _POSIX_C_SOURCE 200809L
 #include "cachelab.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <getopt.h>
-#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include "policy.h"
+#include "trace.h"
+#include "prefetch.h"
+#include "profile.h"
 
-int hit = 0, miss = 0, eviction = 0;
-int s, E, b, S, B;
+/* hierarchy slots, also the order in which levels are reported */
+#define L1I 0
+#define L1D 1
+#define L2  2
+#define L3  3
+#define MAX_LEVELS 4
+
+/* inclusion policies between the levels of a hierarchy */
+#define NINE      0		/* non-inclusive, non-exclusive */
+#define INCLUSIVE 1
+#define EXCLUSIVE 2
+
+/* sharded mode: at most this many workers, each fed by a ring of records */
+#define MAX_SHARDS 64
+#define RING_SIZE  4096
+#define RING_BATCH 64
+#define CACHE_LINE 64
 
 typedef struct _line {
-	int latest;
 	int valid;
+	int dirty;
+	int prefetched;		/* brought in by the prefetcher, not used yet */
+	unsigned long long int sectors;	/* valid sectors of a sectored block */
 	unsigned long long int tag;
-	char* block;
 } line;
 
 typedef struct _set {
 	line* lines;
+	pset meta;
+	unsigned long long int* ghost;	/* tags (+1) evicted by prefetch fills */
+	int ghostnext;
 } set;
 
+/*
+ * counts - statistics of one level gathered by one shard, padded so
+ * that workers never write to the same cache line
+ */
+typedef struct _counts {
+	int hit, miss, eviction, writeback, sectormiss;
+	int pfissued, pfuseful, pfuseless, pfevict, pfpollution;
+	char pad[CACHE_LINE - 10 * sizeof(int)];
+} counts;
+
+/*
+ * cache - one level of the simulated hierarchy. A write-back level
+ * allocates on stores and writes dirty victims to the next level; a
+ * write-through level forwards every store and does not allocate on
+ * store misses.
+ */
 typedef struct _cache {
+	const char* name;
+	int depth;
+	int s, E, b, S;
+	int writethrough;
+	const policy* pol;
 	set* sets;
+	struct _cache* next;	/* next level towards memory, NULL for memory */
+	const prefetcher* pf;
+	void* pfstate;
+	counts count[MAX_SHARDS];
 } cache;
 
-cache init_cache (int setnum, int linenum, int blocknum) {
-	cache newcache;
-	set newset;
+static const char* level_names[MAX_LEVELS] = { "L1i", "L1d", "L2", "L3" };
+static const int level_depths[MAX_LEVELS] = { 1, 1, 2, 3 };
+
+cache* levels[MAX_LEVELS];
+int inclusion = NINE;
+
+/* log2 of the sectors per block (0: whole blocks), and whether the
+   size of an access decides which blocks and sectors it touches */
+int sectorbits = 0;
+int sizeaware = 0;
+
+/*
+ * In sharded mode every worker owns the sets whose index has the low
+ * bits equal to its shard number, in every level at once, and counts
+ * into its own slot of cache.count
+ */
+static __thread int shard = 0;
+#define STAT(c) ((c)->count[shard])
+
+/* reuse-distance and working-set profile of L1d, if requested */
+profile* prof = NULL;
+
+void evicted (cache* c, unsigned long long int addr, unsigned long long int sectors, int dirty);
+
+cache* init_cache (int slot, int s, int E, int b, const policy* pol) {
+	cache* newcache = (cache*) malloc(sizeof(cache));
 	line newline;
 	int setindex, lineindex;
 
-	newcache.sets = (set*) malloc(sizeof(set) * setnum);
+	newcache->name = level_names[slot];
+	newcache->depth = level_depths[slot];
+	newcache->s = s;
+	newcache->E = E;
+	newcache->b = b;
+	newcache->S = 1 << s;
+	newcache->writethrough = 0;
+	newcache->pol = pol;
+	newcache->pf = NULL;
+	newcache->pfstate = NULL;
+	newcache->next = NULL;
+	memset(newcache->count, 0, sizeof(newcache->count));
+	newcache->sets = (set*) malloc(sizeof(set) * newcache->S);
 
-	for (setindex = 0; setindex < setnum; setindex++) {
-		newset.lines = (line*) malloc(sizeof(line) * linenum);
-		newcache.sets[setindex] = newset;
+	for (setindex = 0; setindex < newcache->S; setindex++) {
+		set *newset = &newcache->sets[setindex];
+		newset->lines = (line*) malloc(sizeof(line) * E);
+		init_pset(&newset->meta, E, setindex);
+		newset->ghost = NULL;
+		newset->ghostnext = 0;
 
-		for (lineindex = 0; lineindex < linenum; lineindex++) {
-			newline.latest = 0;
+		for (lineindex = 0; lineindex < E; lineindex++) {
 			newline.valid = 0;
+			newline.dirty = 0;
+			newline.prefetched = 0;
+			newline.sectors = 0;
 			newline.tag = 0;
-			newset.lines[lineindex] = newline;
+			newset->lines[lineindex] = newline;
 		}
 	}
 	return newcache;
 }
 
-void clean(cache mycache) {
+void clean(cache* mycache) {
 	int i;
-	for (i = 0; i < S; i++) {
-		set s = mycache.sets[i];
-		if (s.lines != NULL) {
-			free(s.lines);
+	for (i = 0; i < mycache->S; i++) {
+		set* s = &mycache->sets[i];
+		if (s->lines != NULL) {
+			free(s->lines);
 		}
+		free_pset(&s->meta);
+		free(s->ghost);
+	}
+	if (mycache->sets != NULL) {
+		free(mycache->sets);
 	}
-	if (mycache.sets != NULL) {
-		free(mycache.sets);
+	if (mycache->pf != NULL) {
+		mycache->pf->destroy(mycache->pfstate);
 	}
+	free(mycache);
+}
+
+unsigned long long int setof (cache* c, unsigned long long int addr) {
+	return (addr >> c->b) & (c->S - 1);
 }
 
-int emptyline(set s) {
+unsigned long long int tagof (cache* c, unsigned long long int addr) {
+	return addr >> (c->s + c->b);
+}
+
+int emptyline(set* s, int E) {
 	int i;
-	line l;
 
 	for (i = 0; i < E; i++) {
-		l = s.lines[i];
-		if (l.valid == 0) {
+		if (s->lines[i].valid == 0) {
 			return i;
 		}
 	}
 	return -1;
 }
 
-int evictline(set s, int* usedline) {
-	int maxuse = s.lines[0].latest;
-	int minuse = s.lines[0].latest;
-	int minindex = 0;
-	int i;
+/*
+ * findline - Returns the way holding the block of addr, or -1
+ */
+int findline (cache* c, unsigned long long int addr) {
+	set* s = &c->sets[setof(c, addr)];
+	unsigned long long int inputtag = tagof(c, addr);
+	int lineindex;
+
+	for (lineindex = 0; lineindex < c->E; lineindex++) {
+		if (s->lines[lineindex].valid && s->lines[lineindex].tag == inputtag) {
+			return lineindex;
+		}
+	}
+	return -1;
+}
+
+/*
+ * invalidate - Drop the block of addr from c. Returns -1 if it was not
+ *     cached, otherwise its dirty bit; its valid sectors are stored in
+ *     *sectors unless sectors is NULL.
+ */
+int invalidate (cache* c, unsigned long long int addr, unsigned long long int* sectors) {
+	set* s = &c->sets[setof(c, addr)];
+	int way = findline(c, addr);
+	int dirty;
+
+	if (way == -1) {
+		return -1;
+	}
+	dirty = s->lines[way].dirty;
+	if (sectors != NULL) {
+		*sectors = s->lines[way].sectors;
+	}
+	s->lines[way].valid = 0;
+	s->lines[way].dirty = 0;
+	s->lines[way].sectors = 0;
+	c->pol->invalidate(&s->meta, way, c->E);
+	return dirty;
+}
+
+/*
+ * back_invalidate - Keep an inclusive hierarchy inclusive by removing a
+ *     block evicted from c from every level above it. Returns 1 if one
+ *     of the removed copies was dirty.
+ */
+int back_invalidate (cache* c, unsigned long long int addr) {
+	int i, dirty = 0;
+
+	for (i = 0; i < MAX_LEVELS; i++) {
+		if (levels[i] != NULL && levels[i]->depth < c->depth) {
+			if (invalidate(levels[i], addr, NULL) == 1) {
+				dirty = 1;
+			}
+		}
+	}
+	return dirty;
+}
+
+/*
+ * install - Place the given sectors of the block of addr in c, evicting
+ *     a victim chosen by the replacement policy if the set is full.
+ *     prefetched marks fills requested by the prefetcher.
+ */
+void install (cache* c, unsigned long long int addr, unsigned long long int sectors,
+		int dirty, int prefetched) {
+	unsigned long long int setindex = setof(c, addr);
+	set* s = &c->sets[setindex];
+	unsigned long long int victimaddr = 0, victimsectors = 0;
+	int victimdirty = 0, victim = 0;
+	int way = findline(c, addr);
+
+	if (way != -1) {
+		s->lines[way].sectors |= sectors;
+		s->lines[way].dirty |= dirty;
+		return;
+	}
 
-	for (i = 1; i < E; i++) {
-		if (minuse > s.lines[i].latest) {
-			minindex = i;
-			minuse = s.lines[i].latest;
+	way = emptyline(s, c->E);
+	if (way == -1) {
+		/* evictions by prefetch fills are counted as pfevict only */
+		if (!prefetched) {
+			STAT(c).eviction++;
 		}
+		victim = 1;
+		way = c->pol->victim(&s->meta, c->E);
+		victimaddr = (s->lines[way].tag << (c->s + c->b)) | (setindex << c->b);
+		victimsectors = s->lines[way].sectors;
+		victimdirty = s->lines[way].dirty;
+		c->pol->invalidate(&s->meta, way, c->E);
 
-		if (maxuse < s.lines[i].latest) {
-			maxuse = s.lines[i].latest;
+		if (s->lines[way].prefetched) {
+			STAT(c).pfuseless++;
+		}
+		if (prefetched) {
+			/* remember the victim to tell whether it is missed later */
+			STAT(c).pfevict++;
+			s->ghost[s->ghostnext] = s->lines[way].tag + 1;
+			s->ghostnext = (s->ghostnext + 1) % c->E;
 		}
 	}
 
-	usedline[0] = minuse;
-	usedline[1] = maxuse;
-	return minindex;
+	s->lines[way].tag = tagof(c, addr);
+	s->lines[way].valid = 1;
+	s->lines[way].dirty = dirty;
+	s->lines[way].prefetched = prefetched;
+	s->lines[way].sectors = sectors;
+	c->pol->fill(&s->meta, way, c->E);
+
+	if (victim && prof != NULL && c == levels[L1D]) {
+		profile_evict(prof, setindex, victimaddr, addr);
+	}
+
+	/* the new block is in place before the victim moves down */
+	if (victim) {
+		evicted(c, victimaddr, victimsectors, victimdirty);
+	}
 }
 
-void simulate (cache mycache, unsigned long long int addr) {
-	int lineindex;
-	int full = 1;
-	int prevhit = hit;
+/*
+ * writeback_block - A dirty block arrives from the level above c
+ */
+void writeback_block (cache* c, unsigned long long int addr, unsigned long long int sectors) {
+	int way;
+
+	if (c->writethrough) {
+		if (c->next != NULL) {
+			writeback_block(c->next, addr, sectors);
+		}
+		return;
+	}
+
+	way = findline(c, addr);
+	if (way != -1) {
+		line* l = &c->sets[setof(c, addr)].lines[way];
+
+		l->sectors |= sectors;
+		l->dirty = 1;
+	}
+	else {
+		install(c, addr, sectors, 1, 0);
+	}
+}
+
+/*
+ * evicted - Send a victim of c to the next level according to the
+ *     inclusion policy
+ */
+void evicted (cache* c, unsigned long long int addr, unsigned long long int sectors, int dirty) {
+	if (inclusion == INCLUSIVE && back_invalidate(c, addr)) {
+		dirty = 1;
+	}
+	if (dirty) {
+		STAT(c).writeback++;
+	}
+	if (c->next == NULL) {
+		return;
+	}
+
+	if (inclusion == EXCLUSIVE) {
+		/* lower levels act as victim caches for clean blocks too */
+		install(c->next, addr, sectors, dirty, 0);
+	}
+	else if (dirty) {
+		writeback_block(c->next, addr, sectors);
+	}
+}
+
+/*
+ * fetch_exclusive - Move the block of addr up out of the lower levels
+ *     until every sector in *sectors has been found. Whatever sectors
+ *     the removed copies held are added to *sectors. Returns 1 if one of
+ *     them was dirty.
+ */
+int fetch_exclusive (cache* c, unsigned long long int addr, unsigned long long int* sectors) {
+	unsigned long long int need = *sectors, have;
+	int dirty = 0, found;
 
-	int tagsize = (64 - (s + b));
-	unsigned long long int inputtag = addr >> (s + b);
-	unsigned long long temp = addr << (tagsize);
-	unsigned long long setindex = temp >> (tagsize + b);
+	for (; c != NULL; c = c->next) {
+		found = invalidate(c, addr, &have);
+		if (found != -1) {
+			dirty |= found;
+			*sectors |= have;
+			if ((have & need) == need) {
+				STAT(c).hit++;
+				return dirty;
+			}
+			STAT(c).sectormiss++;
+			need &= ~have;
+		}
+		STAT(c).miss++;
+	}
+	return dirty;
+}
 
-	set s = mycache.sets[setindex];
+/*
+ * pollution_miss - Returns 1 (and forgets it) if the block of addr was
+ *     evicted from c by a prefetch fill
+ */
+int pollution_miss (cache* c, unsigned long long int addr) {
+	set* s = &c->sets[setof(c, addr)];
+	unsigned long long int tag = tagof(c, addr) + 1;
+	int i;
 
-	for (lineindex = 0; lineindex < E; lineindex++) {
-		if (s.lines[lineindex].valid) {
-			if (s.lines[lineindex].tag == inputtag) {
-				s.lines[lineindex].latest++;
-				hit++;
+	for (i = 0; i < c->E; i++) {
+		if (s->ghost[i] == tag) {
+			s->ghost[i] = 0;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * simulate - Access the given sectors of the block of addr in c. A
+ *     block that is cached without all of those sectors counts as a
+ *     miss (and a sector miss) but evicts nothing. Returns 1 if the
+ *     access should trigger the prefetcher: it missed, or it was the
+ *     first use of a prefetched block.
+ */
+int simulate (cache* c, unsigned long long int addr, unsigned long long int sectors, int write) {
+	int lineindex = findline(c, addr);
+	unsigned long long int missing = sectors;
+	set* s = &c->sets[setof(c, addr)];
+	int dirty = 0;
+
+	if (lineindex != -1) {
+		int useful = s->lines[lineindex].prefetched;
+
+		if (useful) {
+			STAT(c).pfuseful++;
+			s->lines[lineindex].prefetched = 0;
+		}
+		c->pol->hit(&s->meta, lineindex, c->E);
+		missing = sectors & ~s->lines[lineindex].sectors;
+		if (missing == 0) {
+			STAT(c).hit++;
+			if (write) {
+				if (!c->writethrough) {
+					s->lines[lineindex].dirty = 1;
+				}
+				else if (c->next != NULL) {
+					simulate(c->next, addr, sectors, 1);
+				}
 			}
+			return useful;
 		}
-		else if (!(s.lines[lineindex].valid) && full) {
-			full = 0;
+		STAT(c).sectormiss++;
+	}
+
+	STAT(c).miss++;
+	if (c->pf != NULL && lineindex == -1 && pollution_miss(c, addr)) {
+		STAT(c).pfpollution++;
+	}
+	if (write && c->writethrough) {
+		/* no-write-allocate: the store goes straight to the next level */
+		if (c->next != NULL) {
+			simulate(c->next, addr, sectors, 1);
 		}
+		return 1;
 	}
 
-	if (prevhit == hit) {
-		miss++;
+	if (inclusion == EXCLUSIVE) {
+		dirty = fetch_exclusive(c->next, addr, &missing);
 	}
-	else {
+	else if (c->next != NULL) {
+		simulate(c->next, addr, missing, 0);
+	}
+	install(c, addr, missing, dirty || write, 0);
+	return 1;
+}
+
+/*
+ * prefetch - Bring the whole block of addr into c unless it is there
+ */
+void prefetch (cache* c, unsigned long long int addr) {
+	unsigned long long int sectors = sectorbits == 6 ? ~0ULL : (1ULL << (1 << sectorbits)) - 1;
+	int dirty = 0;
+
+	if (findline(c, addr) != -1) {
 		return;
 	}
-	int *usedline = (int*) malloc(sizeof(int) * 2);
-	int minindex = evictline(s, usedline);
+	STAT(c).pfissued++;
+	if (inclusion == EXCLUSIVE) {
+		dirty = fetch_exclusive(c->next, addr, &sectors);
+	}
+	else if (c->next != NULL) {
+		simulate(c->next, addr, sectors, 0);
+	}
+	install(c, addr, sectors, dirty, 1);
+}
 
-	if (full) {
-		eviction++;
-		s.lines[minindex].tag = inputtag;
-		s.lines[minindex].latest = usedline[1] + 1;
+/*
+ * attach_prefetcher - Let pf issue prefetches into c, degree blocks ahead
+ */
+void attach_prefetcher (cache* c, const prefetcher* pf, int degree) {
+	int i;
+
+	c->pf = pf;
+	c->pfstate = pf->create(c->b, degree);
+	for (i = 0; i < c->S; i++) {
+		c->sets[i].ghost = (unsigned long long int*) calloc(c->E, sizeof(unsigned long long int));
 	}
+}
 
-	else {
-		int emptyindex = emptyline(s);
-		s.lines[emptyindex].tag = inputtag;
-		s.lines[emptyindex].valid = 1;
-		s.lines[emptyindex].latest = usedline[1] + 1;
+/*
+ * sector_mask - Sectors of the block of addr touched by an access of
+ *     size bytes; the part beyond the end of the block is not included
+ */
+unsigned long long int sector_mask (int b, unsigned long long int addr, unsigned int size) {
+	int shift = b - sectorbits;
+	unsigned long long int first, last;
+	unsigned long long int end = addr + (size ? size : 1) - 1;
+
+	if (sectorbits == 0) {
+		return 1;
+	}
+	if ((end >> b) != (addr >> b)) {
+		end = addr | ((1ULL << b) - 1);
 	}
-	free(usedline);
+	first = (addr >> shift) & ((1ULL << sectorbits) - 1);
+	last = (end >> shift) & ((1ULL << sectorbits) - 1);
+	return (last == 63 ? ~0ULL : (1ULL << (last + 1)) - 1) & ~((1ULL << first) - 1);
+}
+
+/*
+ * read_config - Build the hierarchy described by a config file. Each
+ *     non-comment line is either
+ *         inclusion <inclusive|exclusive|nine>
+ *     or a level
+ *         <L1i|L1d|L2|L3> <s> <E> <b> [policy] [write-back|write-through]
+ *     All levels must share the block size; L1d is required.
+ */
+void read_config (const char* filename, const policy* defpol) {
+	FILE* cfg = fopen(filename, "r");
+	char buf[256], name[16], polname[16], wpol[16];
+	int slot, n, s, E, b, lineno = 0;
+	const policy* pol;
+
+	if (cfg == NULL) {
+		printf("Cannot open config file %s\n", filename);
+		exit(1);
+	}
+
+	while (fgets(buf, sizeof(buf), cfg) != NULL) {
+		lineno++;
+		n = sscanf(buf, "%15s %d %d %d %15s %15s", name, &s, &E, &b, polname, wpol);
+		if (n <= 0 || name[0] == '#') {
+			continue;
+		}
+
+		if (strcmp(name, "inclusion") == 0) {
+			if (sscanf(buf, "%*s %15s", wpol) != 1) {
+				wpol[0] = '\0';
+			}
+			if (strcmp(wpol, "inclusive") == 0) inclusion = INCLUSIVE;
+			else if (strcmp(wpol, "exclusive") == 0) inclusion = EXCLUSIVE;
+			else if (strcmp(wpol, "nine") == 0) inclusion = NINE;
+			else {
+				printf("%s:%d: unknown inclusion policy\n", filename, lineno);
+				exit(1);
+			}
+			continue;
+		}
+
+		for (slot = 0; slot < MAX_LEVELS; slot++) {
+			if (strcmp(name, level_names[slot]) == 0) {
+				break;
+			}
+		}
+		if (slot == MAX_LEVELS || n < 4 || s < 0 || b < 0) {
+			printf("%s:%d: expected <L1i|L1d|L2|L3> <s> <E> <b> [policy] [write policy]\n",
+					filename, lineno);
+			exit(1);
+		}
+
+		pol = defpol;
+		if (n >= 5 && (pol = find_policy(polname)) == NULL) {
+			printf("%s:%d: unknown policy %s\n", filename, lineno, polname);
+			exit(1);
+		}
+		if (!policy_supports(pol, E)) {
+			printf("%s:%d: policy %s does not support E=%d\n", filename, lineno, pol->name, E);
+			exit(1);
+		}
+		if (levels[slot] != NULL) {
+			clean(levels[slot]);
+		}
+		levels[slot] = init_cache(slot, s, E, b, pol);
+
+		if (n == 6) {
+			if (strcmp(wpol, "write-through") == 0) levels[slot]->writethrough = 1;
+			else if (strcmp(wpol, "write-back") != 0) {
+				printf("%s:%d: unknown write policy %s\n", filename, lineno, wpol);
+				exit(1);
+			}
+		}
+	}
+	fclose(cfg);
+
+	if (levels[L1D] == NULL) {
+		printf("%s: the hierarchy needs an L1d level\n", filename);
+		exit(1);
+	}
+	for (slot = 0; slot < MAX_LEVELS; slot++) {
+		if (levels[slot] == NULL) {
+			continue;
+		}
+		if (levels[slot]->b != levels[L1D]->b) {
+			printf("%s: all levels must use the same block size\n", filename);
+			exit(1);
+		}
+		if (inclusion == EXCLUSIVE && levels[slot]->writethrough) {
+			printf("%s: write-through levels cannot be exclusive\n", filename);
+			exit(1);
+		}
+	}
+
+	/* link every level to the closest configured level below it */
+	if (levels[L2] != NULL) {
+		levels[L2]->next = levels[L3];
+	}
+	for (slot = L1I; slot <= L1D; slot++) {
+		if (levels[slot] != NULL) {
+			levels[slot]->next = levels[L2] != NULL ? levels[L2] : levels[L3];
+		}
+	}
+}
+
+/*
+ * demand - A load or store reaches L1d; also tell the profiler
+ */
+int demand (unsigned long long int addr, unsigned long long int sectors, int store) {
+	cache* c = levels[L1D];
+	int misses = STAT(c).miss + STAT(c).sectormiss;
+	int trigger = simulate(c, addr, sectors, store);
+
+	if (prof != NULL) {
+		profile_access(prof, addr, setof(c, addr),
+				STAT(c).miss + STAT(c).sectormiss != misses);
+	}
+	return trigger;
+}
+
+/*
+ * replay - Feed one trace record to the hierarchy. arg points to the
+ *     address of the last instruction fetched, which the caller keeps
+ *     (each shard worker has its own) and the prefetchers are told.
+ */
+void replay (const trace_rec* rec, void* arg) {
+	unsigned long long int* pc = (unsigned long long int*) arg;
+	unsigned long long int sectors = sector_mask(levels[L1D]->b, rec->addr,
+			sizeaware ? rec->size : 1);
+	int trigger = 0;
+
+	switch(rec->op) {
+		case 'I': *pc = rec->addr;
+				  if (levels[L1I] != NULL) {
+					  simulate(levels[L1I], rec->addr, sectors, 0);
+				  }
+				  return;
+		case 'L': trigger = demand(rec->addr, sectors, 0);
+				  break;
+		case 'S': trigger = demand(rec->addr, sectors, 1);
+				  break;
+		case 'M': trigger = demand(rec->addr, sectors, 0);
+				  demand(rec->addr, sectors, 1);
+				  break;
+		default: return;
+	}
+
+	if (levels[L1D]->pf != NULL) {
+		cache* c = levels[L1D];
+		unsigned long long int targets[PREFETCH_MAX_DEGREE];
+		int i, n = c->pf->observe(c->pfstate, *pc, rec->addr, trigger,
+				targets, PREFETCH_MAX_DEGREE);
+
+		for (i = 0; i < n; i++) {
+			prefetch(c, targets[i]);
+		}
+	}
+}
+
+/* where split_access sends the per-block pieces of a record */
+void (*piece_feed)(const trace_rec* rec, void* arg);
+
+/*
+ * split_access - Cut a record that straddles block boundaries into one
+ *     record per block. This runs before sharding, as the pieces may
+ *     belong to different shards.
+ */
+void split_access (const trace_rec* rec, void* arg) {
+	int b = levels[L1D]->b;
+	unsigned long long int addr = rec->addr;
+	unsigned long long int end = rec->addr + (rec->size ? rec->size : 1);
+	unsigned long long int blockend;
+	trace_rec piece = *rec;
+
+	while (addr < end) {
+		blockend = ((addr >> b) + 1) << b;
+		piece.addr = addr;
+		piece.size = (unsigned int)((blockend < end ? blockend : end) - addr);
+		piece_feed(&piece, arg);
+		addr += piece.size;
+	}
+}
+
+/*
+ * ring - single-producer/single-consumer queue of records for one shard.
+ * The producer publishes tail in batches; each index lives on its own
+ * cache line.
+ */
+typedef struct _ring {
+	trace_rec recs[RING_SIZE];
+	unsigned long head __attribute__((aligned(CACHE_LINE)));
+	unsigned long tail __attribute__((aligned(CACHE_LINE)));
+	unsigned long pending;		/* producer-private tail */
+	int done;
+	int shard;
+	pthread_t tid;
+} ring;
+
+ring* rings = NULL;
+int nshards = 1;
+
+void publish (ring* r) {
+	__atomic_store_n(&r->tail, r->pending, __ATOMIC_RELEASE);
+}
+
+/*
+ * dispatch - Route a record to the worker owning its sets. Accesses of
+ *     one block always land in the same shard, so every set sees them
+ *     in trace order.
+ */
+void dispatch (const trace_rec* rec, void* arg) {
+	ring* r = &rings[(rec->addr >> levels[L1D]->b) & (unsigned long long int)(nshards - 1)];
+
+	while (r->pending - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RING_SIZE) {
+		publish(r);
+		sched_yield();
+	}
+	r->recs[r->pending & (RING_SIZE - 1)] = *rec;
+	r->pending++;
+	if ((r->pending & (RING_BATCH - 1)) == 0) {
+		publish(r);
+	}
+}
+
+void* shard_worker (void* arg) {
+	ring* r = (ring*) arg;
+	unsigned long head = 0, tail;
+	unsigned long long int pc = 0;
+
+	shard = r->shard;
+	for (;;) {
+		tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			if (__atomic_load_n(&r->done, __ATOMIC_ACQUIRE) &&
+					head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) {
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+		for (; head != tail; head++) {
+			replay(&r->recs[head & (RING_SIZE - 1)], &pc);
+		}
+		__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+/*
+ * start_shards - Spawn nshards workers. Shard bits are the low set index
+ *     bits, so every level must have at least nshards sets.
+ */
+void start_shards (void) {
+	int i;
+
+	for (i = 0; i < MAX_LEVELS; i++) {
+		if (levels[i] != NULL && levels[i]->S < nshards) {
+			printf("%s has fewer than %d sets to shard\n", levels[i]->name, nshards);
+			exit(1);
+		}
+	}
+
+	if (posix_memalign((void**) &rings, CACHE_LINE, sizeof(ring) * nshards) != 0) {
+		printf("Cannot allocate %d shard rings\n", nshards);
+		exit(1);
+	}
+	for (i = 0; i < nshards; i++) {
+		rings[i].head = rings[i].tail = rings[i].pending = 0;
+		rings[i].done = 0;
+		rings[i].shard = i;
+		if (pthread_create(&rings[i].tid, NULL, shard_worker, &rings[i]) != 0) {
+			printf("Cannot start shard worker %d\n", i);
+			exit(1);
+		}
+	}
+}
+
+/*
+ * stop_shards - Flush the rings and wait until every worker drained its own
+ */
+void stop_shards (void) {
+	int i;
+
+	for (i = 0; i < nshards; i++) {
+		publish(&rings[i]);
+		__atomic_store_n(&rings[i].done, 1, __ATOMIC_RELEASE);
+	}
+	for (i = 0; i < nshards; i++) {
+		pthread_join(rings[i].tid, NULL);
+	}
+	free(rings);
+}
+
+/*
+ * total_counts - Merge the per-shard statistics of c
+ */
+counts total_counts (cache* c) {
+	counts total;
+	int i;
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < MAX_SHARDS; i++) {
+		total.hit += c->count[i].hit;
+		total.miss += c->count[i].miss;
+		total.eviction += c->count[i].eviction;
+		total.writeback += c->count[i].writeback;
+		total.sectormiss += c->count[i].sectormiss;
+		total.pfissued += c->count[i].pfissued;
+		total.pfuseful += c->count[i].pfuseful;
+		total.pfuseless += c->count[i].pfuseless;
+		total.pfevict += c->count[i].pfevict;
+		total.pfpollution += c->count[i].pfpollution;
+	}
+	return total;
+}
+
+/*
+ * regular_file - Returns 1 if filename can be memory-mapped as a whole
+ */
+int regular_file (const char* filename) {
+	struct stat st;
+
+	return stat(filename, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char* argv[]) {
+	printf("Usage: %s [-h] [-p <policy>] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+	printf("       %s [-h] [-p <policy>] -c <config> -t <file>\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h          Print this help message.\n");
+	printf("  -s <num>    Number of set index bits.\n");
+	printf("  -E <num>    Number of lines per set.\n");
+	printf("  -b <num>    Number of block offset bits.\n");
+	printf("  -t <file>   Trace file; - or a pipe is simulated as it arrives.\n");
+	printf("  -p <policy> Replacement policy (default lru): %s\n", policy_names());
+	printf("  -c <config> Simulate the L1i/L1d/L2/L3 hierarchy in <config>.\n");
+	printf("  -j <num>    Trace decoder threads (default: one per CPU).\n");
+	printf("  -o <file>   Also save the trace in compact binary form.\n");
+	printf("  -a          Use access sizes: touch every block and sector an access spans.\n");
+	printf("  -u <num>    Split every block into <num> sectors (power of 2).\n");
+	printf("  -f <name>[:<degree>]  Prefetch into L1d with %s.\n", prefetcher_names());
+	printf("  -T <num>    Simulate with <num> workers owning disjoint sets (power of 2).\n");
+	printf("  -r <prefix> Profile L1d reuse distances, working set and conflicts\n");
+	printf("              into <prefix>-{reuse,wss,sets,conflicts}.csv.\n");
+	printf("  -w <num>    Working-set window of the profile, in accesses (default %d).\n", PROFILE_WINDOW);
+	printf("  -m <file>   Label conflicts with the matrices in <file> (tracegen's .regions).\n");
 }
 
 int main (int argc, char* argv[]) {
-	int opt;
-	char inst;
-	char* tracefilename;
-	cache mycache;
-	unsigned long long int addr;
-	int size;
-
-	while ( (opt = getopt(argc, argv, "s:E:b:t:h")) != -1) {
+	int opt, i;
+	int s = 0, E = 0, b = 0;
+	int nthreads = 0, sectors = 1;
+	size_t r;
+	char* tracefilename = NULL;
+	char* configfilename = NULL;
+	char* binaryfilename = NULL;
+	char* pfname = NULL;
+	char* profileprefix = NULL;
+	char* regionsfilename = NULL;
+	unsigned long long int window = PROFILE_WINDOW;
+	unsigned long long int pc = 0;
+	const policy* pol = find_policy("lru");
+	void (*feed)(const trace_rec* rec, void* arg) = replay;
+	counts total;
+	trace t;
+
+	while ( (opt = getopt(argc, argv, "s:E:b:t:p:c:j:o:T:au:f:r:w:m:h")) != -1) {
 		switch(opt) {
 			case 's': s = atoi(optarg);
 					  break;
@@ -160,34 +880,191 @@ int main (int argc, char* argv[]) {
 					  break;
 			case 't': tracefilename = optarg;
 					  break;
-			case 'h': exit(0);
-			default: exit(1);
-		}
-	}
-
-	S = pow(2.0, s);
-	B = pow(2.0, b);
-	mycache = init_cache (S, E, B);
-	FILE* tracefile = fopen(tracefilename, "r");
-
-	if (tracefile != NULL) {
-		while (fscanf(tracefile, "%c %llx,%d", &inst, &addr, &size) != EOF) {
-			switch(inst) {
-				case 'I': break;
-				case 'L': simulate(mycache, addr);
-						  break;
-				case 'S': simulate(mycache, addr);
-						  break;
-				case 'M': simulate(mycache, addr);
-						  simulate(mycache, addr);
-						  break;
-				default: break;
+			case 'p': pol = find_policy(optarg);
+					  if (pol == NULL) {
+						  printf("Unknown policy: %s\n", optarg);
+						  usage(argv);
+						  exit(1);
+					  }
+					  break;
+			case 'c': configfilename = optarg;
+					  break;
+			case 'j': nthreads = atoi(optarg);
+					  break;
+			case 'o': binaryfilename = optarg;
+					  break;
+			case 'T': nshards = atoi(optarg);
+					  if (nshards < 1 || nshards > MAX_SHARDS || (nshards & (nshards - 1)) != 0) {
+						  printf("-T needs a power of 2 between 1 and %d\n", MAX_SHARDS);
+						  exit(1);
+					  }
+					  break;
+			case 'a': sizeaware = 1;
+					  break;
+			case 'f': pfname = optarg;
+					  break;
+			case 'r': profileprefix = optarg;
+					  break;
+			case 'w': window = strtoull(optarg, NULL, 0);
+					  if (window == 0) {
+						  printf("-w needs a positive number of accesses\n");
+						  exit(1);
+					  }
+					  break;
+			case 'm': regionsfilename = optarg;
+					  break;
+			case 'u': sectors = atoi(optarg);
+					  if (sectors < 1 || sectors > 64 || (sectors & (sectors - 1)) != 0) {
+						  printf("-u needs a power of 2 between 1 and 64\n");
+						  exit(1);
+					  }
+					  while ((1 << sectorbits) < sectors) {
+						  sectorbits++;
+					  }
+					  break;
+			case 'h': usage(argv);
+					  exit(0);
+			default: usage(argv);
+					 exit(1);
+		}
+	}
+
+	if (tracefilename == NULL) {
+		printf("Missing required command line argument\n");
+		usage(argv);
+		exit(1);
+	}
+
+	if (configfilename != NULL) {
+		read_config(configfilename, pol);
+	}
+	else {
+		if (!policy_supports(pol, E)) {
+			printf("Policy %s does not support E=%d\n", pol->name, E);
+			exit(1);
+		}
+		levels[L1D] = init_cache(L1D, s, E, b, pol);
+	}
+
+	if (sectorbits > levels[L1D]->b) {
+		printf("Cannot split %d-byte blocks into %d sectors\n", 1 << levels[L1D]->b, sectors);
+		exit(1);
+	}
+
+	if (pfname != NULL) {
+		char* colon = strchr(pfname, ':');
+		int degree = colon != NULL ? atoi(colon + 1) : 1;
+		const prefetcher* pf;
+
+		if (colon != NULL) {
+			*colon = '\0';
+		}
+		if ((pf = find_prefetcher(pfname)) == NULL ||
+				degree < 1 || degree > PREFETCH_MAX_DEGREE) {
+			printf("-f needs one of %s, with a degree from 1 to %d\n",
+					prefetcher_names(), PREFETCH_MAX_DEGREE);
+			exit(1);
+		}
+		if (nshards > 1) {
+			/* prefetchers see the whole access stream, not one shard */
+			printf("-f cannot be combined with -T\n");
+			exit(1);
+		}
+		attach_prefetcher(levels[L1D], pf, degree);
+	}
+
+	if (profileprefix != NULL) {
+		if (nshards > 1) {
+			/* reuse distances need the accesses in trace order */
+			printf("-r cannot be combined with -T\n");
+			exit(1);
+		}
+		prof = new_profile(levels[L1D]->b, 1 << levels[L1D]->s, window);
+		if (regionsfilename != NULL && read_regions(prof, regionsfilename) < 0) {
+			perror(regionsfilename);
+			exit(1);
+		}
+	}
+
+	if (nshards > 1) {
+		start_shards();
+		feed = dispatch;
+	}
+	if (sizeaware) {
+		piece_feed = feed;
+		feed = split_access;
+	}
+
+	if (strcmp(tracefilename, "-") == 0 || !regular_file(tracefilename)) {
+		int fd = strcmp(tracefilename, "-") == 0 ? 0 : open(tracefilename, O_RDONLY);
+
+		if (binaryfilename != NULL) {
+			printf("-o needs a trace file, not a stream\n");
+			exit(1);
+		}
+		if (fd < 0 || stream_trace(fd, feed, &pc) < 0) {
+			perror(tracefilename);
+			exit(1);
+		}
+		if (fd != 0) {
+			close(fd);
+		}
+	}
+	else {
+		init_trace(&t);
+		if (read_trace(tracefilename, nthreads, &t) < 0) {
+			perror(tracefilename);
+			exit(1);
+		}
+		if (binaryfilename != NULL && write_binary_trace(binaryfilename, &t) < 0) {
+			perror(binaryfilename);
+			exit(1);
+		}
+
+		for (r = 0; r < t.count; r++) {
+			feed(&t.recs[r], &pc);
+		}
+		free_trace(&t);
+	}
+
+	if (nshards > 1) {
+		stop_shards();
+	}
+
+	if (configfilename != NULL || sectorbits > 0 || pfname != NULL) {
+		for (i = 0; i < MAX_LEVELS; i++) {
+			if (levels[i] != NULL) {
+				total = total_counts(levels[i]);
+				printf("%-3s hits:%d misses:%d evictions:%d writebacks:%d",
+						levels[i]->name, total.hit, total.miss,
+						total.eviction, total.writeback);
+				if (sectorbits > 0) {
+					printf(" sector-misses:%d", total.sectormiss);
+				}
+				printf("\n");
+				if (levels[i]->pf != NULL) {
+					printf("%-3s prefetches:%d useful:%d useless:%d pollution-evictions:%d pollution-misses:%d\n",
+							levels[i]->name, total.pfissued, total.pfuseful, total.pfuseless,
+							total.pfevict, total.pfpollution);
+				}
 			}
 		}
 	}
+	if (prof != NULL) {
+		if (write_profile(prof, profileprefix) < 0) {
+			perror(profileprefix);
+			exit(1);
+		}
+		free_profile(prof);
+	}
 
-	printSummary(hit, miss, eviction);
-	clean(mycache);
-	fclose(tracefile);
+	total = total_counts(levels[L1D]);
+	printSummary(total.hit, total.miss, total.eviction);
+
+	for (i = 0; i < MAX_LEVELS; i++) {
+		if (levels[i] != NULL) {
+			clean(levels[i]);
+		}
+	}
 	return 0;
 }
@@ -0,0 +1,77 @@
+/*
+ * instrument.c - In-process access tracing for the transpose functions
+ */
+#include <stddef.h>
+#include "instrument.h"
+
+static cache_model *model = NULL;
+static unsigned long long int a_lo, a_hi, b_lo, b_hi;
+static unsigned long long int others;
+
+void start_recording(cache_model *m, const void *a, unsigned long long int alen,
+		const void *b, unsigned long long int blen)
+{
+	a_lo = (unsigned long long int) a;
+	a_hi = a_lo + alen;
+	b_lo = (unsigned long long int) b;
+	b_hi = b_lo + blen;
+	others = 0;
+	model = m;
+}
+
+unsigned long long int stop_recording(void)
+{
+	model = NULL;
+	return others;
+}
+
+/*
+ * record - One access of size bytes at addr. It is counted as one
+ *     access to the block of its first byte, whatever its size, the
+ *     way csim-ref counts the accesses of a valgrind trace.
+ */
+static void record(unsigned long long int addr, unsigned long long int size)
+{
+	if (model == NULL) {
+		return;
+	}
+	if ((addr < a_lo || addr >= a_hi) && (addr < b_lo || addr >= b_hi)) {
+		others++;
+		return;
+	}
+	model_access(model, addr);
+}
+
+/* The functions -fsanitize=kernel-address calls before each access */
+#define HOOKS(size) \
+	void __asan_load##size##_noabort(unsigned long long int addr) { record(addr, size); } \
+	void __asan_store##size##_noabort(unsigned long long int addr) { record(addr, size); }
+
+void __asan_load1_noabort(unsigned long long int addr);
+void __asan_store1_noabort(unsigned long long int addr);
+void __asan_load2_noabort(unsigned long long int addr);
+void __asan_store2_noabort(unsigned long long int addr);
+void __asan_load4_noabort(unsigned long long int addr);
+void __asan_store4_noabort(unsigned long long int addr);
+void __asan_load8_noabort(unsigned long long int addr);
+void __asan_store8_noabort(unsigned long long int addr);
+void __asan_load16_noabort(unsigned long long int addr);
+void __asan_store16_noabort(unsigned long long int addr);
+void __asan_loadN_noabort(unsigned long long int addr, unsigned long long int size);
+void __asan_storeN_noabort(unsigned long long int addr, unsigned long long int size);
+
+HOOKS(1)
+HOOKS(2)
+HOOKS(4)
+HOOKS(8)
+HOOKS(16)
+
+void __asan_loadN_noabort(unsigned long long int addr, unsigned long long int size)
+{
+	record(addr, size);
+}
+
+void __asan_storeN_noabort(unsigned long long int addr, unsigned long long int size)
+{
+	record(addr, size);
+}
@@ -0,0 +1,35 @@
+/*
+ * instrument.h - In-process access tracing for the transpose functions
+ *
+ * tracegen links an instrumented build of trans.c (see the Makefile):
+ * the compiler's kernel address sanitizer instrumentation is asked to
+ * call a function before every load and store, and instrument.c
+ * supplies those functions. While recording, every access that falls
+ * in A or B goes to the cache model as one access to the block of its
+ * first byte, as csim-ref counts a valgrind trace; other accesses,
+ * such as locals of an unoptimized build, are only counted.
+ *
+ * The hooks load the model, so a binary traced with valgrind must link
+ * the uninstrumented trans.o instead (tracegen-valgrind), or the loads
+ * would show up in its trace.
+ */
+
+#ifndef CSIM_INSTRUMENT_H
+#define CSIM_INSTRUMENT_H
+
+#include "cachemodel.h"
+
+/*
+ * start_recording - Send accesses to [a, a + alen) and [b, b + blen)
+ *     to m from now on
+ */
+void start_recording(cache_model *m, const void *a, unsigned long long int alen,
+		const void *b, unsigned long long int blen);
+
+/*
+ * stop_recording - Stop sending accesses to the model. Returns the
+ *     number of accesses outside A and B seen while recording.
+ */
+unsigned long long int stop_recording(void);
+
+#endif /* CSIM_INSTRUMENT_H */
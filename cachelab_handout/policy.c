@@ -0,0 +1,257 @@
+/*
+ * policy.c - Replacement policies for the cache simulator
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "policy.h"
+
+/*
+ * Recency list helpers shared by LRU and FIFO. The list runs from the
+ * most recently inserted/used way (head) to the next victim (tail);
+ * ways that hold no block are not linked.
+ */
+static void list_unlink(pset *p, int way)
+{
+	int prev = p->prev[way];
+	int next = p->next[way];
+
+	if (prev != -1) p->next[prev] = next;
+	else if (p->head == way) p->head = next;
+	if (next != -1) p->prev[next] = prev;
+	else if (p->tail == way) p->tail = prev;
+	p->prev[way] = p->next[way] = -1;
+}
+
+static void list_push(pset *p, int way)
+{
+	p->prev[way] = -1;
+	p->next[way] = p->head;
+	if (p->head != -1) p->prev[p->head] = way;
+	p->head = way;
+	if (p->tail == -1) p->tail = way;
+}
+
+static void recency_fill(pset *p, int way, int E)
+{
+	list_push(p, way);
+}
+
+static void recency_invalidate(pset *p, int way, int E)
+{
+	list_unlink(p, way);
+}
+
+static int recency_victim(pset *p, int E)
+{
+	return p->tail;
+}
+
+/* lru - true LRU: a hit moves the way to the head of the list */
+static void lru_hit(pset *p, int way, int E)
+{
+	if (p->head == way) return;
+	list_unlink(p, way);
+	list_push(p, way);
+}
+
+/* fifo - hits leave the insertion order untouched */
+static void fifo_hit(pset *p, int way, int E)
+{
+}
+
+/* nop_update - for policies that keep no state for that event */
+static void nop_update(pset *p, int way, int E)
+{
+}
+
+/* random - xorshift64 generator kept per set so runs are reproducible */
+static int random_victim(pset *p, int E)
+{
+	unsigned long long int x = p->state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	p->state = x;
+	return (int)(x % (unsigned long long int)E);
+}
+
+/*
+ * tplru - tree pseudo-LRU. Node n (1 <= n < E) of the implicit binary
+ * tree is bit n of p->bits; a set bit sends the next victim search to
+ * the right child.
+ */
+static void tplru_hit(pset *p, int way, int E)
+{
+	int node = 1;
+	int span = E >> 1;
+
+	while (node < E) {
+		int right = (way & span) != 0;
+
+		if (right) p->bits &= ~(1ULL << node);
+		else p->bits |= 1ULL << node;
+		node = 2 * node + right;
+		span >>= 1;
+	}
+}
+
+static int tplru_victim(pset *p, int E)
+{
+	int node = 1;
+
+	while (node < E) {
+		node = 2 * node + (int)((p->bits >> node) & 1);
+	}
+	return node - E;
+}
+
+/*
+ * bplru - bit pseudo-LRU (MRU bits). Each access sets the way's bit;
+ * when all bits would be set, every other bit is cleared. The victim is
+ * the lowest way whose bit is clear.
+ */
+static unsigned long long int full_mask(int E)
+{
+	return E >= POLICY_MAX_BITS ? ~0ULL : (1ULL << E) - 1;
+}
+
+static void bplru_hit(pset *p, int way, int E)
+{
+	p->bits |= 1ULL << way;
+	if (p->bits == full_mask(E)) {
+		p->bits = 1ULL << way;
+	}
+}
+
+static void bplru_invalidate(pset *p, int way, int E)
+{
+	p->bits &= ~(1ULL << way);
+}
+
+static int bplru_victim(pset *p, int E)
+{
+	unsigned long long int empty = ~p->bits & full_mask(E);
+
+	return empty ? __builtin_ctzll(empty) : 0;
+}
+
+/*
+ * srrip/brrip - static and bimodal re-reference interval prediction
+ * with 2-bit RRPVs. Hits predict a near re-reference; SRRIP inserts
+ * with a long interval, BRRIP with a distant one except once every
+ * BRRIP_THROTTLE fills.
+ */
+static void rrip_hit(pset *p, int way, int E)
+{
+	p->rrpv[way] = 0;
+}
+
+static void srrip_fill(pset *p, int way, int E)
+{
+	p->rrpv[way] = RRPV_LONG;
+}
+
+static void brrip_fill(pset *p, int way, int E)
+{
+	p->rrpv[way] = (p->state++ % BRRIP_THROTTLE) == 0 ? RRPV_LONG : RRPV_MAX;
+}
+
+static void rrip_invalidate(pset *p, int way, int E)
+{
+	p->rrpv[way] = RRPV_MAX;
+}
+
+static int rrip_victim(pset *p, int E)
+{
+	int i, oldest = 0;
+
+	for (i = 1; i < E; i++) {
+		if (p->rrpv[i] > p->rrpv[oldest]) {
+			oldest = i;
+		}
+	}
+	/* age the whole set at once instead of one step per search */
+	if (p->rrpv[oldest] < RRPV_MAX) {
+		int age = RRPV_MAX - p->rrpv[oldest];
+
+		for (i = 0; i < E; i++) {
+			p->rrpv[i] += age;
+		}
+	}
+	return oldest;
+}
+
+static const policy policies[] = {
+	{ "lru",    lru_hit,    recency_fill, recency_invalidate, recency_victim },
+	{ "fifo",   fifo_hit,   recency_fill, recency_invalidate, recency_victim },
+	{ "random", nop_update, nop_update,   nop_update,         random_victim },
+	{ "tplru",  tplru_hit,  tplru_hit,    nop_update,         tplru_victim },
+	{ "bplru",  bplru_hit,  bplru_hit,    bplru_invalidate,   bplru_victim },
+	{ "srrip",  rrip_hit,   srrip_fill,   rrip_invalidate,    rrip_victim },
+	{ "brrip",  rrip_hit,   brrip_fill,   rrip_invalidate,    rrip_victim },
+};
+
+#define NUM_POLICIES ((int)(sizeof(policies) / sizeof(policies[0])))
+
+const policy *find_policy(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NUM_POLICIES; i++) {
+		if (strcmp(policies[i].name, name) == 0) {
+			return &policies[i];
+		}
+	}
+	return NULL;
+}
+
+int policy_supports(const policy *pol, int E)
+{
+	if (E < 1) {
+		return 0;
+	}
+	if (pol->victim == tplru_victim) {
+		/* the tree needs a power of two number of leaves */
+		return E <= POLICY_MAX_BITS && (E & (E - 1)) == 0;
+	}
+	if (pol->victim == bplru_victim) {
+		return E <= POLICY_MAX_BITS;
+	}
+	return 1;
+}
+
+const char *policy_names(void)
+{
+	return "lru, fifo, random, tplru, bplru, srrip, brrip";
+}
+
+void init_pset(pset *p, int E, unsigned long long int setindex)
+{
+	int i;
+	unsigned long long int z = (setindex + 1) * 0x9e3779b97f4a7c15ULL;
+
+	p->head = p->tail = -1;
+	p->prev = (int*) malloc(sizeof(int) * E);
+	p->next = (int*) malloc(sizeof(int) * E);
+	p->rrpv = (unsigned char*) malloc(sizeof(unsigned char) * E);
+	for (i = 0; i < E; i++) {
+		p->prev[i] = p->next[i] = -1;
+		p->rrpv[i] = RRPV_MAX;
+	}
+	p->bits = 0;
+
+	/* splitmix64 finalizer; never yields a zero xorshift state here */
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	p->state = (z ^ (z >> 31)) | 1;
+}
+
+void free_pset(pset *p)
+{
+	free(p->prev);
+	free(p->next);
+	free(p->rrpv);
+	p->prev = p->next = NULL;
+	p->rrpv = NULL;
+}
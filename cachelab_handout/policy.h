@@ -0,0 +1,79 @@
+/*
+ * policy.h - Pluggable replacement policies for the cache simulator
+ *
+ * A policy only sees the per-set metadata block (pset) and way numbers;
+ * it never looks at tags. The simulator calls hit() on every hit,
+ * fill() after a block is placed in a way, invalidate() when a block
+ * leaves the set without being replaced, and victim() to choose a way
+ * when every line of the set is valid. All hit/fill/invalidate updates
+ * are constant time; victim() is constant time except for RRIP, which
+ * ages the set like the hardware does.
+ */
+
+#ifndef CSIM_POLICY_H
+#define CSIM_POLICY_H
+
+/* Largest associativity supported by the bit-vector policies */
+#define POLICY_MAX_BITS 64
+
+/* Re-reference prediction values used by SRRIP/BRRIP (2-bit RRPV) */
+#define RRPV_MAX  3
+#define RRPV_LONG 2
+
+/* BRRIP inserts with a long re-reference interval once every 32 fills */
+#define BRRIP_THROTTLE 32
+
+/*
+ * pset - per-set replacement metadata. Each policy uses only the
+ * fields it needs:
+ *   head, tail, prev, next   recency/insertion order (LRU, FIFO)
+ *   bits                     PLRU tree or MRU bits
+ *   rrpv                     re-reference prediction values (RRIP)
+ *   state                    random number state / BRRIP fill counter
+ */
+typedef struct _pset {
+	int head;
+	int tail;
+	int *prev;
+	int *next;
+	unsigned char *rrpv;
+	unsigned long long int bits;
+	unsigned long long int state;
+} pset;
+
+typedef struct _policy {
+	const char *name;
+	void (*hit)(pset *p, int way, int E);
+	void (*fill)(pset *p, int way, int E);
+	void (*invalidate)(pset *p, int way, int E);
+	int (*victim)(pset *p, int E);
+} policy;
+
+/*
+ * find_policy - Look up a policy by name ("lru", "fifo", "random",
+ *     "tplru", "bplru", "srrip", "brrip"). Returns NULL if the name is
+ *     unknown.
+ */
+const policy *find_policy(const char *name);
+
+/*
+ * policy_supports - Returns 1 if the policy can manage sets with E ways
+ */
+int policy_supports(const policy *pol, int E);
+
+/*
+ * policy_names - Comma separated list of the known policies for usage
+ *     messages
+ */
+const char *policy_names(void);
+
+/*
+ * init_pset - Allocate the metadata of set number setindex with E ways.
+ *     The seed makes the random policies reproducible per set.
+ */
+void init_pset(pset *p, int E, unsigned long long int setindex);
+
+/* free_pset - Release the metadata allocated by init_pset */
+void free_pset(pset *p);
+
+#endif /* CSIM_POLICY_H */
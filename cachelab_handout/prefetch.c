@@ -0,0 +1,222 @@
+/*
+ * prefetch.c - Hardware prefetcher models for the cache simulator
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+
+/* common state: block size and how many blocks to fetch ahead */
+typedef struct _pf_base {
+	int b;
+	int degree;
+} pf_base;
+
+/*
+ * next-line - tagged next-line prefetching: every trigger fetches the
+ * degree blocks that follow the accessed one
+ */
+static void *nextline_create(int b, int degree)
+{
+	pf_base *pf = (pf_base*) malloc(sizeof(pf_base));
+
+	pf->b = b;
+	pf->degree = degree;
+	return pf;
+}
+
+static int nextline_observe(void *state, unsigned long long int pc,
+		unsigned long long int addr, int trigger,
+		unsigned long long int *out, int max)
+{
+	pf_base *pf = (pf_base*) state;
+	unsigned long long int block = addr >> pf->b;
+	int i, n = 0;
+
+	if (!trigger) {
+		return 0;
+	}
+	for (i = 1; i <= pf->degree && n < max; i++) {
+		out[n++] = (block + i) << pf->b;
+	}
+	return n;
+}
+
+/*
+ * stride - reference prediction table (Chen and Baer) indexed by the
+ * instruction address. An entry moves between the initial, transient,
+ * steady and no-prediction states as strides repeat or change, and
+ * prefetches addr + k * stride while steady.
+ */
+#define RPT_INITIAL   0
+#define RPT_TRANSIENT 1
+#define RPT_STEADY    2
+#define RPT_NOPRED    3
+
+typedef struct _rpt_entry {
+	unsigned long long int pc;
+	unsigned long long int last;
+	long long int stride;
+	int state;
+	int valid;
+} rpt_entry;
+
+typedef struct _pf_stride {
+	pf_base base;
+	rpt_entry table[RPT_ENTRIES];
+} pf_stride;
+
+static void *stride_create(int b, int degree)
+{
+	pf_stride *pf = (pf_stride*) calloc(1, sizeof(pf_stride));
+
+	pf->base.b = b;
+	pf->base.degree = degree;
+	return pf;
+}
+
+static int stride_observe(void *state, unsigned long long int pc,
+		unsigned long long int addr, int trigger,
+		unsigned long long int *out, int max)
+{
+	pf_stride *pf = (pf_stride*) state;
+	rpt_entry *e = &pf->table[(pc ^ (pc >> 8)) % RPT_ENTRIES];
+	long long int stride = (long long int)(addr - e->last);
+	int correct = (stride == e->stride);
+	int i, n = 0;
+
+	if (!e->valid || e->pc != pc) {
+		e->valid = 1;
+		e->pc = pc;
+		e->last = addr;
+		e->stride = 0;
+		e->state = RPT_INITIAL;
+		return 0;
+	}
+
+	switch (e->state) {
+		case RPT_INITIAL:   e->state = correct ? RPT_STEADY : RPT_TRANSIENT;
+							break;
+		case RPT_TRANSIENT: e->state = correct ? RPT_STEADY : RPT_NOPRED;
+							break;
+		case RPT_STEADY:    e->state = correct ? RPT_STEADY : RPT_INITIAL;
+							break;
+		default:            e->state = correct ? RPT_TRANSIENT : RPT_NOPRED;
+							break;
+	}
+	/* the stride is only replaced when the prediction was not steady */
+	if (!correct && e->state != RPT_INITIAL) {
+		e->stride = stride;
+	}
+	e->last = addr;
+
+	if (e->state != RPT_STEADY || e->stride == 0) {
+		return 0;
+	}
+	for (i = 1; i <= pf->base.degree && n < max; i++) {
+		unsigned long long int target = addr + (unsigned long long int)(e->stride * i);
+
+		/* strides inside a block would prefetch the block itself */
+		if ((target >> pf->base.b) != (addr >> pf->base.b)) {
+			out[n++] = (target >> pf->base.b) << pf->base.b;
+		}
+	}
+	return n;
+}
+
+/*
+ * stream - detects ascending or descending runs of missing blocks and,
+ * once a run is confirmed, keeps degree blocks ahead of it
+ */
+typedef struct _stream {
+	unsigned long long int last;	/* last block of the run */
+	int dir;
+	int confidence;
+	unsigned long long int lru;
+	int valid;
+} stream;
+
+typedef struct _pf_stream {
+	pf_base base;
+	stream streams[STREAM_ENTRIES];
+	unsigned long long int clock;
+} pf_stream;
+
+static void *stream_create(int b, int degree)
+{
+	pf_stream *pf = (pf_stream*) calloc(1, sizeof(pf_stream));
+
+	pf->base.b = b;
+	pf->base.degree = degree;
+	return pf;
+}
+
+static int stream_observe(void *state, unsigned long long int pc,
+		unsigned long long int addr, int trigger,
+		unsigned long long int *out, int max)
+{
+	pf_stream *pf = (pf_stream*) state;
+	unsigned long long int block = addr >> pf->base.b;
+	stream *st, *victim = &pf->streams[0];
+	int i, n = 0;
+
+	if (!trigger) {
+		return 0;
+	}
+	pf->clock++;
+
+	for (i = 0; i < STREAM_ENTRIES; i++) {
+		st = &pf->streams[i];
+		if (st->valid && (block == st->last + 1 || block == st->last - 1)) {
+			int dir = (block == st->last + 1) ? 1 : -1;
+
+			st->confidence = (dir == st->dir) ? st->confidence + 1 : 1;
+			st->dir = dir;
+			st->last = block;
+			st->lru = pf->clock;
+			if (st->confidence >= 2) {
+				for (i = 1; i <= pf->base.degree && n < max; i++) {
+					out[n++] = (block + (unsigned long long int)(dir * i)) << pf->base.b;
+				}
+			}
+			return n;
+		}
+		if (!st->valid || st->lru < victim->lru) {
+			victim = st;
+		}
+		if (!victim->valid) {
+			break;
+		}
+	}
+
+	victim->valid = 1;
+	victim->last = block;
+	victim->dir = 0;
+	victim->confidence = 0;
+	victim->lru = pf->clock;
+	return 0;
+}
+
+static const prefetcher prefetchers[] = {
+	{ "next-line", nextline_create, nextline_observe, free },
+	{ "stride",    stride_create,   stride_observe,   free },
+	{ "stream",    stream_create,   stream_observe,   free },
+};
+
+#define NUM_PREFETCHERS ((int)(sizeof(prefetchers) / sizeof(prefetchers[0])))
+
+const prefetcher *find_prefetcher(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NUM_PREFETCHERS; i++) {
+		if (strcmp(prefetchers[i].name, name) == 0) {
+			return &prefetchers[i];
+		}
+	}
+	return NULL;
+}
+
+const char *prefetcher_names(void)
+{
+	return "next-line, stride, stream";
+}
@@ -0,0 +1,46 @@
+/*
+ * prefetch.h - Hardware prefetcher models for the cache simulator
+ *
+ * A prefetcher watches the demand accesses of one cache level and
+ * proposes blocks to bring in ahead of time. The simulator calls
+ * observe() after each demand access with the instruction address of
+ * the access (the last 'I' record of the trace), the accessed address
+ * and whether it was a trigger, i.e. a miss or the first use of a
+ * prefetched block. observe() stores at most max block-aligned
+ * addresses in out and returns how many it stored.
+ */
+
+#ifndef CSIM_PREFETCH_H
+#define CSIM_PREFETCH_H
+
+/* Reference prediction table of the stride prefetcher */
+#define RPT_ENTRIES 256
+
+/* Streams tracked by the stream prefetcher */
+#define STREAM_ENTRIES 8
+
+/* Upper bound on the prefetch degree */
+#define PREFETCH_MAX_DEGREE 16
+
+typedef struct _prefetcher {
+	const char *name;
+	void *(*create)(int b, int degree);
+	int (*observe)(void *state, unsigned long long int pc,
+			unsigned long long int addr, int trigger,
+			unsigned long long int *out, int max);
+	void (*destroy)(void *state);
+} prefetcher;
+
+/*
+ * find_prefetcher - Look up a prefetcher by name ("next-line", "stride",
+ *     "stream"). Returns NULL if the name is unknown.
+ */
+const prefetcher *find_prefetcher(const char *name);
+
+/*
+ * prefetcher_names - Comma separated list of the known prefetchers for
+ *     usage messages
+ */
+const char *prefetcher_names(void);
+
+#endif /* CSIM_PREFETCH_H */
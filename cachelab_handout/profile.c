@@ -0,0 +1,444 @@
+/*
+ * profile.c - Reuse-distance and working-set profiler for the cache simulator
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+/* bin 0 holds distance 0, bin k distances 2^(k-1) .. 2^k - 1 */
+#define HIST_BINS 65
+
+/* labels of blocks inside a region carry the region number up here */
+#define LABEL_SHIFT 56
+
+typedef struct _region {
+	char name[16];
+	unsigned long long int base;
+	unsigned long long int rows;
+	unsigned long long int rowbytes;
+} region;
+
+/* blockinfo - time of the last access to a block and the last window */
+typedef struct _blockinfo {
+	unsigned long long int block;
+	unsigned long long int last;
+	unsigned long long int window;	/* window number + 1, 0 if none */
+	int used;
+} blockinfo;
+
+/* conflict - how often evictor's block evicted victim's block in set */
+typedef struct _conflict {
+	unsigned long long int set;
+	unsigned long long int victim;
+	unsigned long long int evictor;
+	unsigned long long int count;
+	int used;
+} conflict;
+
+struct _profile {
+	int b;
+	int S;
+
+	/* reuse distances: Fenwick tree over access times, one marker at
+	   the last access time of every block */
+	unsigned long long int *tree;
+	size_t cap;
+	size_t now;
+	blockinfo *blocks;
+	size_t bcap, bcount;
+	unsigned long long int hist[HIST_BINS];
+	unsigned long long int cold;
+	unsigned long long int accesses;
+
+	/* working set per window */
+	unsigned long long int window;
+	unsigned long long int windistinct;
+	unsigned long long int *wss;
+	size_t nwss, wsscap;
+
+	/* per-set counters */
+	unsigned long long int *setacc, *setmiss, *setevict;
+
+	/* conflicts */
+	region regions[PROFILE_MAX_REGIONS];
+	int nregions;
+	conflict *conflicts;
+	size_t ccap, ccount;
+};
+
+static unsigned long long int mix(unsigned long long int x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	return x ^ (x >> 33);
+}
+
+profile *new_profile(int b, int S, unsigned long long int window)
+{
+	profile *p = (profile*) calloc(1, sizeof(profile));
+
+	p->b = b;
+	p->S = S;
+	p->window = window ? window : PROFILE_WINDOW;
+	p->cap = 1 << 16;
+	p->tree = (unsigned long long int*) calloc(p->cap + 1, sizeof(unsigned long long int));
+	p->bcap = 1 << 12;
+	p->blocks = (blockinfo*) calloc(p->bcap, sizeof(blockinfo));
+	p->ccap = 1 << 10;
+	p->conflicts = (conflict*) calloc(p->ccap, sizeof(conflict));
+	p->setacc = (unsigned long long int*) calloc(S, sizeof(unsigned long long int));
+	p->setmiss = (unsigned long long int*) calloc(S, sizeof(unsigned long long int));
+	p->setevict = (unsigned long long int*) calloc(S, sizeof(unsigned long long int));
+	return p;
+}
+
+void free_profile(profile *p)
+{
+	free(p->tree);
+	free(p->blocks);
+	free(p->conflicts);
+	free(p->wss);
+	free(p->setacc);
+	free(p->setmiss);
+	free(p->setevict);
+	free(p);
+}
+
+int read_regions(profile *p, const char *filename)
+{
+	FILE *in = fopen(filename, "r");
+	region *r;
+
+	if (in == NULL) {
+		return -1;
+	}
+	while (p->nregions < PROFILE_MAX_REGIONS) {
+		r = &p->regions[p->nregions];
+		if (fscanf(in, "%15s %llx %llu %llu", r->name, &r->base, &r->rows, &r->rowbytes) != 4) {
+			break;
+		}
+		if (r->rowbytes > 0) {
+			p->nregions++;
+		}
+	}
+	fclose(in);
+	return p->nregions;
+}
+
+/*
+ * Fenwick tree over the time slots 0 .. cap-1
+ */
+static void fenwick_add(profile *p, size_t i, long long int delta)
+{
+	for (i++; i <= p->cap; i += i & (~i + 1)) {
+		p->tree[i] += (unsigned long long int) delta;
+	}
+}
+
+static unsigned long long int fenwick_sum(profile *p, size_t i)
+{
+	unsigned long long int sum = 0;
+
+	for (i++; i > 0; i -= i & (~i + 1)) {
+		sum += p->tree[i];
+	}
+	return sum;
+}
+
+static int by_last(const void *a, const void *b)
+{
+	const blockinfo *x = *(const blockinfo* const*) a;
+	const blockinfo *y = *(const blockinfo* const*) b;
+
+	return (x->last > y->last) - (x->last < y->last);
+}
+
+/*
+ * compact - Out of time slots: renumber the last access times of all
+ *     blocks to 0 .. bcount-1, keeping their order, and rebuild the tree
+ */
+static void compact(profile *p)
+{
+	blockinfo **order = (blockinfo**) malloc(sizeof(blockinfo*) * (p->bcount + 1));
+	size_t i, n = 0, parent;
+
+	for (i = 0; i < p->bcap; i++) {
+		if (p->blocks[i].used == 1) {
+			order[n++] = &p->blocks[i];
+		}
+	}
+	qsort(order, n, sizeof(blockinfo*), by_last);
+	for (i = 0; i < n; i++) {
+		order[i]->last = i;
+	}
+	free(order);
+
+	if (n * 2 > p->cap) {
+		p->cap *= 2;
+		free(p->tree);
+		p->tree = (unsigned long long int*) malloc(sizeof(unsigned long long int) * (p->cap + 1));
+	}
+	memset(p->tree, 0, sizeof(unsigned long long int) * (p->cap + 1));
+	for (i = 1; i <= p->cap; i++) {
+		p->tree[i] += (i <= n);
+		parent = i + (i & (~i + 1));
+		if (parent <= p->cap) {
+			p->tree[parent] += p->tree[i];
+		}
+	}
+	p->now = n;
+}
+
+static void grow_blocks(profile *p)
+{
+	blockinfo *old = p->blocks;
+	size_t i, j, oldcap = p->bcap;
+
+	p->bcap *= 2;
+	p->blocks = (blockinfo*) calloc(p->bcap, sizeof(blockinfo));
+	for (i = 0; i < oldcap; i++) {
+		if (old[i].used) {
+			j = mix(old[i].block) & (p->bcap - 1);
+			while (p->blocks[j].used) {
+				j = (j + 1) & (p->bcap - 1);
+			}
+			p->blocks[j] = old[i];
+		}
+	}
+	free(old);
+}
+
+/*
+ * find_block - Returns the entry of block, inserting an unused-looking
+ *     one (used == 2) on the first access
+ */
+static blockinfo *find_block(profile *p, unsigned long long int block)
+{
+	size_t i;
+
+	if ((p->bcount + 1) * 2 > p->bcap) {
+		grow_blocks(p);
+	}
+	for (i = mix(block) & (p->bcap - 1); p->blocks[i].used; i = (i + 1) & (p->bcap - 1)) {
+		if (p->blocks[i].block == block) {
+			return &p->blocks[i];
+		}
+	}
+	p->blocks[i].used = 2;
+	p->blocks[i].block = block;
+	p->blocks[i].window = 0;
+	p->bcount++;
+	return &p->blocks[i];
+}
+
+static void end_window(profile *p)
+{
+	if (p->nwss == p->wsscap) {
+		p->wsscap = p->wsscap ? p->wsscap * 2 : 64;
+		p->wss = (unsigned long long int*) realloc(p->wss, sizeof(unsigned long long int) * p->wsscap);
+	}
+	p->wss[p->nwss++] = p->windistinct;
+	p->windistinct = 0;
+}
+
+void profile_access(profile *p, unsigned long long int addr,
+		unsigned long long int set, int miss)
+{
+	blockinfo *e = find_block(p, addr >> p->b);
+	unsigned long long int distance;
+	int bin = 0;
+
+	if (p->now == p->cap) {
+		compact(p);
+	}
+
+	if (e->used == 2) {
+		e->used = 1;
+		p->cold++;
+	}
+	else {
+		distance = fenwick_sum(p, p->now - 1) - fenwick_sum(p, e->last);
+		while (bin < HIST_BINS - 1 && (distance >> bin) != 0) {
+			bin++;
+		}
+		p->hist[bin]++;
+		fenwick_add(p, e->last, -1);
+	}
+	fenwick_add(p, p->now, 1);
+	e->last = p->now++;
+
+	if (e->window != p->nwss + 1) {
+		e->window = p->nwss + 1;
+		p->windistinct++;
+	}
+	if (++p->accesses % p->window == 0) {
+		end_window(p);
+	}
+
+	p->setacc[set]++;
+	if (miss) {
+		p->setmiss[set]++;
+	}
+}
+
+/*
+ * label - Name a block by the matrix row it lies in, or by its address
+ */
+static unsigned long long int label(profile *p, unsigned long long int addr)
+{
+	int r;
+
+	for (r = 0; r < p->nregions; r++) {
+		region *rg = &p->regions[r];
+
+		if (addr >= rg->base && addr < rg->base + rg->rows * rg->rowbytes) {
+			return ((unsigned long long int)(r + 1) << LABEL_SHIFT) |
+				((addr - rg->base) / rg->rowbytes);
+		}
+	}
+	return (addr >> p->b) << p->b;
+}
+
+static void format_label(profile *p, unsigned long long int l, char *buf, size_t len)
+{
+	int r = (int)(l >> LABEL_SHIFT);
+
+	if (r > 0) {
+		snprintf(buf, len, "%s[%llu]", p->regions[r - 1].name,
+				l & ((1ULL << LABEL_SHIFT) - 1));
+	}
+	else {
+		snprintf(buf, len, "0x%llx", l);
+	}
+}
+
+static void grow_conflicts(profile *p)
+{
+	conflict *old = p->conflicts;
+	size_t i, j, oldcap = p->ccap;
+
+	p->ccap *= 2;
+	p->conflicts = (conflict*) calloc(p->ccap, sizeof(conflict));
+	for (i = 0; i < oldcap; i++) {
+		if (old[i].used) {
+			j = mix(old[i].set ^ mix(old[i].victim ^ mix(old[i].evictor))) & (p->ccap - 1);
+			while (p->conflicts[j].used) {
+				j = (j + 1) & (p->ccap - 1);
+			}
+			p->conflicts[j] = old[i];
+		}
+	}
+	free(old);
+}
+
+void profile_evict(profile *p, unsigned long long int set,
+		unsigned long long int victim, unsigned long long int addr)
+{
+	unsigned long long int v = label(p, victim);
+	unsigned long long int e = label(p, addr);
+	size_t i;
+
+	p->setevict[set]++;
+
+	if ((p->ccount + 1) * 2 > p->ccap) {
+		grow_conflicts(p);
+	}
+	for (i = mix(set ^ mix(v ^ mix(e))) & (p->ccap - 1); p->conflicts[i].used;
+			i = (i + 1) & (p->ccap - 1)) {
+		conflict *c = &p->conflicts[i];
+
+		if (c->set == set && c->victim == v && c->evictor == e) {
+			c->count++;
+			return;
+		}
+	}
+	p->conflicts[i].used = 1;
+	p->conflicts[i].set = set;
+	p->conflicts[i].victim = v;
+	p->conflicts[i].evictor = e;
+	p->conflicts[i].count = 1;
+	p->ccount++;
+}
+
+static int by_count(const void *a, const void *b)
+{
+	const conflict *x = (const conflict*) a;
+	const conflict *y = (const conflict*) b;
+
+	if (x->used != y->used) return y->used - x->used;
+	return (x->count < y->count) - (x->count > y->count);
+}
+
+static FILE *open_csv(const char *prefix, const char *name)
+{
+	char filename[4096];
+
+	snprintf(filename, sizeof(filename), "%s-%s.csv", prefix, name);
+	return fopen(filename, "w");
+}
+
+int write_profile(profile *p, const char *prefix)
+{
+	unsigned long long int hits = 0;
+	char victim[64], evictor[64];
+	size_t i;
+	int bin;
+	FILE *out;
+
+	if ((out = open_csv(prefix, "reuse")) == NULL) {
+		return -1;
+	}
+	fprintf(out, "min_distance,max_distance,count,lru_hit_ratio\n");
+	for (bin = 0; bin < HIST_BINS; bin++) {
+		unsigned long long int lo = bin ? 1ULL << (bin - 1) : 0;
+
+		hits += p->hist[bin];
+		if (p->hist[bin] > 0) {
+			fprintf(out, "%llu,%llu,%llu,%.6f\n", lo, bin ? (lo << 1) - 1 : 0,
+					p->hist[bin], (double) hits / (double) p->accesses);
+		}
+	}
+	fprintf(out, "cold,cold,%llu,\n", p->cold);
+	fclose(out);
+
+	if ((out = open_csv(prefix, "wss")) == NULL) {
+		return -1;
+	}
+	if (p->windistinct > 0) {
+		end_window(p);
+	}
+	fprintf(out, "window,first_access,blocks,bytes\n");
+	for (i = 0; i < p->nwss; i++) {
+		fprintf(out, "%zu,%llu,%llu,%llu\n", i, i * p->window, p->wss[i], p->wss[i] << p->b);
+	}
+	fclose(out);
+
+	if ((out = open_csv(prefix, "sets")) == NULL) {
+		return -1;
+	}
+	fprintf(out, "set,accesses,misses,evictions\n");
+	for (i = 0; i < (size_t) p->S; i++) {
+		fprintf(out, "%zu,%llu,%llu,%llu\n", i, p->setacc[i], p->setmiss[i], p->setevict[i]);
+	}
+	fclose(out);
+
+	if ((out = open_csv(prefix, "conflicts")) == NULL) {
+		return -1;
+	}
+	qsort(p->conflicts, p->ccap, sizeof(conflict), by_count);
+	p->ccap = p->ccount;	/* the table is a sorted list from now on */
+	fprintf(out, "set,victim,evictor,count\n");
+	for (i = 0; i < p->ccount; i++) {
+		format_label(p, p->conflicts[i].victim, victim, sizeof(victim));
+		format_label(p, p->conflicts[i].evictor, evictor, sizeof(evictor));
+		fprintf(out, "%llu,%s,%s,%llu\n", p->conflicts[i].set, victim, evictor,
+				p->conflicts[i].count);
+	}
+	fclose(out);
+	return 0;
+}
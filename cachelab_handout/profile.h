@@ -0,0 +1,66 @@
+/*
+ * profile.h - Reuse-distance and working-set profiler for the cache simulator
+ *
+ * The profiler watches the demand accesses and evictions of the L1d
+ * level and writes four CSV files:
+ *   <prefix>-reuse.csv      reuse-distance histogram (distinct blocks
+ *                           between two accesses to a block, log2 bins)
+ *                           with the hit ratio of a fully associative
+ *                           LRU cache of each size
+ *   <prefix>-wss.csv        distinct blocks touched per time window
+ *   <prefix>-sets.csv       accesses, misses and evictions per set
+ *   <prefix>-conflicts.csv  which blocks evict which, per set, labelled
+ *                           with matrix rows (e.g. A[3]) when the
+ *                           matrices are known
+ * Reuse distances are kept with a Fenwick tree over access times, so
+ * each access costs O(log n).
+ */
+
+#ifndef CSIM_PROFILE_H
+#define CSIM_PROFILE_H
+
+/* Matrices (or other row-major regions) used to label conflicts */
+#define PROFILE_MAX_REGIONS 8
+
+/* Default working-set window, in accesses */
+#define PROFILE_WINDOW 10000
+
+typedef struct _profile profile;
+
+/*
+ * new_profile - Start profiling a level with 2^b byte blocks and S sets,
+ *     measuring the working set every window accesses
+ */
+profile *new_profile(int b, int S, unsigned long long int window);
+
+/* free_profile - Release everything held by p */
+void free_profile(profile *p);
+
+/*
+ * read_regions - Load region lines "<name> <hex base> <rows> <row bytes>",
+ *     as written by tracegen into .regions. Returns the number of
+ *     regions read, or -1 if the file cannot be opened.
+ */
+int read_regions(profile *p, const char *filename);
+
+/*
+ * profile_access - Record a demand access to addr in set, and whether
+ *     it missed
+ */
+void profile_access(profile *p, unsigned long long int addr,
+		unsigned long long int set, int miss);
+
+/*
+ * profile_evict - Record that filling the block of addr into set
+ *     evicted the block at victim
+ */
+void profile_evict(profile *p, unsigned long long int set,
+		unsigned long long int victim, unsigned long long int addr);
+
+/*
+ * write_profile - Write the CSV files named after prefix. Returns 0 on
+ *     success and -1 with errno set on failure.
+ */
+int write_profile(profile *p, const char *prefix);
+
+#endif /* CSIM_PROFILE_H */
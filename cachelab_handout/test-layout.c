@@ -0,0 +1,183 @@
+/*
+ * test-layout.c - Checks the correctness and performance of the layout
+ *     functions registered in trans.c, for every element size each of
+ *     them takes: the misses on the graded cache, counted by tracegen's
+ *     instrumented build, and the wall-clock time on this machine.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "cachelab.h"
+
+/* Maximum array dimension */
+#define MAXN 256
+
+/* Wall-clock timing: best of TIME_RUNS runs of at least TIME_MIN_NS */
+#define TIME_RUNS 5
+#define TIME_MIN_NS 1000000.0
+
+/* External function defined in trans.c */
+extern void registerFunctions();
+
+/* External variables defined in cachelab.c */
+extern layout_func_t layout_list[MAX_LAYOUT_FUNCS];
+extern int layout_counter;
+
+/* Globals set on the command line */
+static int M = 0;
+static int N = 0;
+
+/* Matrices for timing the functions natively, and the expected result */
+static unsigned char time_a[MAXN * MAXN * MAX_ELEM_SIZE];
+static unsigned char time_b[MAXN * MAXN * MAX_ELEM_SIZE];
+static unsigned char time_c[MAXN * MAXN * MAX_ELEM_SIZE];
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *stop)
+{
+    return (stop->tv_sec - start->tv_sec) * 1e9 + (stop->tv_nsec - start->tv_nsec);
+}
+
+/*
+ * simulate - Count the misses of layout function i on size-byte elements
+ *     with tracegen. Returns 0 and the counts, or -1 if it is incorrect.
+ */
+static int simulate(int i, int size, unsigned int *hits, unsigned int *misses,
+                    unsigned int *evictions)
+{
+    int status, found;
+    char cmd[255];
+    FILE* in_fp;
+
+    sprintf(cmd, "./tracegen -M %d -N %d -L %d -z %d -s 5 -E 1 -b 5 > /dev/null",
+            M, N, i, size);
+    status = system(cmd);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    in_fp = fopen(".csim_results", "r");
+    if (!in_fp)
+        return -1;
+    found = fscanf(in_fp, "%u %u %u", hits, misses, evictions) == 3;
+    fclose(in_fp);
+    return found ? 0 : -1;
+}
+
+/*
+ * time_layout - Best wall-clock time of one call of layout function i
+ *     on size-byte elements, in ns, or -1 if its result is wrong
+ */
+static double time_layout(int i, int size)
+{
+    struct timespec start, stop;
+    double ns, best;
+    long reps, r;
+    int run;
+    void (*fn)(int, int, size_t, const void*, void*) = layout_list[i].func_ptr;
+
+    initLayout(M, N, size, time_a);
+    (*fn)(M, N, size, time_a, time_b);
+    correctLayout(layout_list[i].kind, M, N, size, time_a, time_c);
+    if (memcmp(time_b, time_c, (size_t) M * N * size) != 0)
+        return -1;
+
+    /* Repeat enough calls for the clock to resolve them */
+    for (reps = 1; ; reps *= 2) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (r = 0; r < reps; r++)
+            (*fn)(M, N, size, time_a, time_b);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        if (elapsed_ns(&start, &stop) >= TIME_MIN_NS)
+            break;
+    }
+    best = elapsed_ns(&start, &stop) / reps;
+    for (run = 1; run < TIME_RUNS; run++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (r = 0; r < reps; r++)
+            (*fn)(M, N, size, time_a, time_b);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        ns = elapsed_ns(&start, &stop) / reps;
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-h] -M <rows> -N <cols> [-z <size>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
+    printf("  -N <cols>   Number of matrix columns (max %d)\n", MAXN);
+    printf("  -z <size>   Only elements of 1, 2, 4, 8 or 16 bytes (default: all)\n");
+    printf("Example: %s -M 64 -N 64 -z 8\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[])
+{
+    char c;
+    int i, size, only = 0;
+    unsigned int hits, misses, evictions;
+    double ns;
+
+    while ((c = getopt(argc,argv,"M:N:z:h")) != -1) {
+        switch(c) {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 'z':
+            only = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (M <= 0 || N <= 0 || M > MAXN || N > MAXN ||
+        (only != 0 && !ELEM_SIZE_OK(only))) {
+        printf("Error: Missing or bad argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    registerFunctions();
+
+    printf("%dx%d, misses on s=5, E=1, b=5 and time per call (best of %d runs)\n",
+           M, N, TIME_RUNS);
+    for (i = 0; i < layout_counter; i++) {
+        for (size = 1; size <= MAX_ELEM_SIZE; size *= 2) {
+            if ((only != 0 && size != only) ||
+                (layout_list[i].elem_size != 0 && layout_list[i].elem_size != size))
+                continue;
+
+            printf("layout %d (%s), %2d-byte: ", i, layout_list[i].description, size);
+            if (simulate(i, size, &hits, &misses, &evictions) < 0 ||
+                (ns = time_layout(i, size)) < 0) {
+                printf("incorrect! Run ./tracegen -M %d -N %d -L %d -z %d for details.\n",
+                       M, N, i, size);
+                continue;
+            }
+
+            /* Every element is read once and written once */
+            printf("misses:%u, %.0f ns, %.2f GB/s\n", misses, ns,
+                   2.0 * size * M * N / ns);
+        }
+    }
+    return 0;
+}
@@ -3,6 +3,7 @@
  *     student's transpose functions and records the results for their
  *     official submitted version as well.
  */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,6 +15,10 @@
 #include "cachelab.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 /* Maximum array dimension */
 #define MAXN 256
@@ -22,6 +27,15 @@
    student submits for credit */
 #define SUBMIT_DESCRIPTION "Transpose submission"
 
+/* The reference cache simulator grades the filtered trace, which it
+   reads from a FIFO as it is produced */
+#define SIMULATOR "./csim-ref"
+#define TRACE_FIFO ".trace_fifo"
+
+/* Wall-clock timing: best of TIME_RUNS runs of at least TIME_MIN_NS */
+#define TIME_RUNS 5
+#define TIME_MIN_NS 1000000.0
+
 /* External function defined in trans.c */
 extern void registerFunctions();
 
@@ -32,6 +46,8 @@ extern int func_counter;
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static int use_valgrind = 0;
+static int time_funcs = 0;
 
 /* The correctness and performance for the submitted transpose function */
 struct results {
@@ -41,23 +57,133 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
+/*
+ * read_marker - Load the marker addresses that tracegen records before
+ *     it runs the first transpose function. Returns 1 once they exist.
+ */
+static int read_marker(unsigned long long int *marker_start,
+                       unsigned long long int *marker_end)
+{
+    int found;
+    FILE* marker_fp = fopen(".marker", "r");
+
+    if (!marker_fp)
+        return 0;
+    found = fscanf(marker_fp, "%llx %llx", marker_start, marker_end) == 2;
+    fclose(marker_fp);
+    return found;
+}
+
+/*
+ * simulate_valgrind - Trace transpose function i with valgrind and
+ *     simulate the accesses between its markers with csim-ref. Returns
+ *     the exit status of tracegen: 0, or i+1 if the function is
+ *     incorrect.
+ */
+int simulate_valgrind(int i, unsigned int s, unsigned int E, unsigned int b)
+{
+    int flag,status,have_marker;
+    unsigned int len;
+    unsigned long long int marker_start = 0, marker_end = 0, addr;
+    char buf[1000], cmd[255];
+
+    /* Valgrind's output is a pipe and the simulator's input a FIFO */
+    FILE* full_trace_fp;  
+    FILE* part_trace_fp; 
+    FILE* sim_fp;
+
+    /* A stale marker file from an earlier run must not be picked up */
+    unlink(".marker");
+
+    /* Use valgrind to generate the trace and simulate it as it
+       is produced, without storing it on disk */
+    sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen-valgrind -M %d -N %d -F %d", M, N,i);
+    full_trace_fp = popen(cmd, "r");
+    assert(full_trace_fp);
+    unlink(TRACE_FIFO);
+    if (mkfifo(TRACE_FIFO, 0600) < 0) {
+        perror(TRACE_FIFO);
+        exit(1);
+    }
+    sprintf(cmd, "%s -s %u -E %u -b %u -t %s > /dev/null", SIMULATOR, s, E, b, TRACE_FIFO);
+    sim_fp = popen(cmd, "w");
+    assert(sim_fp);
+    part_trace_fp = fopen(TRACE_FIFO, "w");
+    assert(part_trace_fp);
+
+    /* Forward the trace corresponding to the trans function. Valgrind
+       keeps writing until tracegen exits, so the pipe is drained. */
+    flag = 0;
+    have_marker = 0;
+    while (fgets(buf, 1000, full_trace_fp) != NULL) {
+
+        /* We are only interested in memory access instructions */
+        if (flag < 2 && buf[0]==' ' && buf[2]==' ' &&
+            (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
+            sscanf(buf+3, "%llx,%u", &addr, &len);
+
+            /* tracegen writes .marker before its first one-byte
+               marker store, so it is only looked for then */
+            if (!have_marker && buf[1]=='S' && len == 1)
+                have_marker = read_marker(&marker_start, &marker_end);
+    
+            /* If start marker found, set flag */
+            if (have_marker && addr == marker_start)
+                flag = 1;
+
+            /* Valgrind creates many spurious accesses to the
+               stack that have nothing to do with the students
+               code. At the moment, we are ignoring all stack
+               accesses by using the simple filter of recording
+               accesses to only the low 32-bit portion of the
+               address space. At some point it would be nice to
+               try to do more informed filtering so that would
+               eliminate the valgrind stack references while
+               include the student stack references. */
+            if (flag == 1 && addr < 0xffffffff) {
+                fputs(buf, part_trace_fp);
+            }
+
+            /* if end marker found, stop forwarding */
+            if (have_marker && addr == marker_end) {
+                flag = 2;
+            }
+        }
+    }
+
+    /* Closing the simulator's input lets it print its results */
+    fclose(part_trace_fp);
+    pclose(sim_fp);
+    unlink(TRACE_FIFO);
+    status = pclose(full_trace_fp);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+/*
+ * simulate_inprocess - Let tracegen run transpose function i through
+ *     its instrumented build and in-process cache model, which counts
+ *     exactly the accesses to A and B. Returns like simulate_valgrind.
+ */
+int simulate_inprocess(int i, unsigned int s, unsigned int E, unsigned int b)
+{
+    int status;
+    char cmd[255];
+
+    sprintf(cmd, "./tracegen -M %d -N %d -F %d -s %u -E %u -b %u > /dev/null", M, N, i, s, E, b);
+    status = system(cmd);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
 /* 
  * eval_perf - Evaluate the performance of the registered transpose functions
  */
 void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 {
     int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128];
+    unsigned int hits, misses, evictions;
 
     registerFunctions(); 
 
-    /* Open the complete trace file */
-    FILE* full_trace_fp;  
-    FILE* part_trace_fp; 
-
     /* Evaluate the performance of each registered transpose function */
 
     for (i=0; i<func_counter; i++) {
@@ -66,22 +192,18 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 
 
         printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
+        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+        fflush(stdout);
 
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
+        if (use_valgrind)
+            flag = simulate_valgrind(i, s, E, b);
+        else
+            flag = simulate_inprocess(i, s, E, b);
         if (0!=flag) {
             printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
             continue;
         }
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
-
-
         func_list[i].correct=1;
 
         /* Save the correctness of the transpose submission */
@@ -89,59 +211,7 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.correct = 1;
         }
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
-        }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
+        /* Collect results from the simulator */
         FILE* in_fp = fopen(".csim_results","r");
         assert(in_fp);
         fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
@@ -160,16 +230,366 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
   
 }
 
+/* Matrices for timing the functions natively, outside valgrind */
+static int time_a[MAXN * MAXN];
+static int time_b[MAXN * MAXN];
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *stop)
+{
+    return (stop->tv_sec - start->tv_sec) * 1e9 + (stop->tv_nsec - start->tv_nsec);
+}
+
+/*
+ * eval_time - Measure the wall-clock time of each registered transpose
+ *     function on this machine, next to its simulated miss count
+ */
+void eval_time()
+{
+    int (*A)[M] = (int (*)[M]) time_a;
+    int (*B)[N] = (int (*)[N]) time_b;
+    struct timespec start, stop;
+    double ns, best;
+    long reps, r;
+    int i, j, k, run, ok;
+
+    printf("\nWall-clock time per call (best of %d runs):\n", TIME_RUNS);
+    for (i = 0; i < func_counter; i++) {
+        initMatrix(M, N, A, B);
+        (*func_list[i].func_ptr)(M, N, A, B);
+        ok = 1;
+        for (j = 0; j < N && ok; j++)
+            for (k = 0; k < M && ok; k++)
+                ok = A[j][k] == B[k][j];
+        if (!ok) {
+            printf("func %u (%s): incorrect, not timed\n", i, func_list[i].description);
+            continue;
+        }
+
+        /* Repeat enough calls for the clock to resolve them */
+        for (reps = 1; ; reps *= 2) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (r = 0; r < reps; r++)
+                (*func_list[i].func_ptr)(M, N, A, B);
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            if (elapsed_ns(&start, &stop) >= TIME_MIN_NS)
+                break;
+        }
+        best = elapsed_ns(&start, &stop) / reps;
+        for (run = 1; run < TIME_RUNS; run++) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (r = 0; r < reps; r++)
+                (*func_list[i].func_ptr)(M, N, A, B);
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            ns = elapsed_ns(&start, &stop) / reps;
+            if (ns < best)
+                best = ns;
+        }
+
+        /* Every element is read once and written once */
+        printf("func %u (%s): %.0f ns, %.2f GB/s, misses:%u\n", i,
+               func_list[i].description, best,
+               2.0 * sizeof(int) * M * N / best, func_list[i].num_misses);
+    }
+}
+
+/* Batch mode: shapes and caches read from a file, run by tracegen -S */
+#define MAX_CONFIGS 256
+#define MAX_WORKERS 64
+#define SERVER "./tracegen"
+
+/* config - One shape and cache geometry of a batch */
+struct config {
+    int M, N;
+    unsigned int s, E, b;
+};
+
+/* outcome - The result of one function on one config */
+struct outcome {
+    int correct;
+    unsigned int hits, misses, evictions;
+};
+
+/* worker - A tracegen server and the job it is running, or -1 */
+struct worker {
+    pid_t pid;
+    FILE* to;
+    FILE* from;
+    int job;
+};
+
+/*
+ * read_batch - Load "M N [s E b]" lines, '#' starting a comment, with
+ *     the cache defaulting to the graded s=5, E=1, b=5. Returns the
+ *     number of configs, or -1 on an unreadable file or bad line.
+ */
+static int read_batch(const char *filename, struct config *configs)
+{
+    char line[256];
+    int n = 0, fields, lineno = 0;
+    char *hash;
+    struct config *c;
+    FILE* fp = fopen(filename, "r");
+
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if ((hash = strchr(line, '#')) != NULL)
+            *hash = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+        if (n == MAX_CONFIGS) {
+            printf("Error: %s: more than %d configs\n", filename, MAX_CONFIGS);
+            fclose(fp);
+            return -1;
+        }
+        c = &configs[n];
+        c->s = 5;
+        c->E = 1;
+        c->b = 5;
+        fields = sscanf(line, "%d %d %u %u %u", &c->M, &c->N, &c->s, &c->E, &c->b);
+        if ((fields != 2 && fields != 5) || c->M <= 0 || c->N <= 0 ||
+            c->M > MAXN || c->N > MAXN || c->s > 20 || c->E < 1 ||
+            c->b < 2 || c->b > 20) {
+            printf("Error: %s:%d: expected \"M N [s E b]\"\n", filename, lineno);
+            fclose(fp);
+            return -1;
+        }
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+/*
+ * start_worker - Fork a tracegen server with pipes to its stdin and
+ *     stdout. Returns 0, or -1 if it could not be started.
+ */
+static int start_worker(struct worker *w)
+{
+    int in[2], out[2];
+
+    if (pipe(in) < 0)
+        return -1;
+    if (pipe(out) < 0) {
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    /* Later servers must not inherit this one's pipes, or closing its
+       stdin would never reach it */
+    fcntl(in[1], F_SETFD, FD_CLOEXEC);
+    fcntl(out[0], F_SETFD, FD_CLOEXEC);
+    fflush(stdout);
+    if ((w->pid = fork()) < 0) {
+        close(in[0]); close(in[1]);
+        close(out[0]); close(out[1]);
+        return -1;
+    }
+    if (w->pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]); close(in[1]);
+        close(out[0]); close(out[1]);
+        execl(SERVER, SERVER, "-S", (char *) NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    w->to = fdopen(in[1], "w");
+    w->from = fdopen(out[0], "r");
+    w->job = -1;
+    return 0;
+}
+
+/* stop_worker - Close a server's pipes and reap it */
+static void stop_worker(struct worker *w)
+{
+    if (w->to)
+        fclose(w->to);
+    if (w->from)
+        fclose(w->from);
+    waitpid(w->pid, NULL, 0);
+    w->to = w->from = NULL;
+    w->pid = -1;
+}
+
+/* send_job - Hand job (config job / func_counter, function
+   job % func_counter) to an idle worker */
+static void send_job(struct worker *w, const struct config *configs, int job)
+{
+    const struct config *c = &configs[job / func_counter];
+
+    w->job = job;
+    fprintf(w->to, "%d %d %d %u %u %u\n", c->M, c->N, job % func_counter,
+            c->s, c->E, c->b);
+    fflush(w->to);
+}
+
+/* json_string - Write s as a JSON string literal */
+static void json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20)
+            fprintf(fp, "\\u%04x", *s);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/* write_report - Write the functions and every outcome as one JSON object */
+static void write_report(FILE *fp, const struct config *configs, int nconfigs,
+                         const struct outcome *outcomes)
+{
+    int i, job;
+
+    fprintf(fp, "{\n  \"functions\": [");
+    for (i = 0; i < func_counter; i++) {
+        fprintf(fp, "%s\n    {\"id\": %d, \"description\": ", i ? "," : "", i);
+        json_string(fp, func_list[i].description);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ],\n  \"submission\": %d,\n  \"results\": [", results.funcid);
+    for (job = 0; job < nconfigs * func_counter; job++) {
+        const struct config *c = &configs[job / func_counter];
+        const struct outcome *o = &outcomes[job];
+
+        fprintf(fp, "%s\n    {\"M\": %d, \"N\": %d, \"s\": %u, \"E\": %u, \"b\": %u, "
+                "\"function\": %d, \"correct\": %s, \"hits\": %u, \"misses\": %u, "
+                "\"evictions\": %u}", job ? "," : "", c->M, c->N, c->s, c->E, c->b,
+                job % func_counter, o->correct ? "true" : "false",
+                o->hits, o->misses, o->evictions);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+/*
+ * eval_batch - Evaluate every registered function on every config of
+ *     filename across nworkers tracegen servers and write the JSON
+ *     report to outfile, or stdout if it is NULL. Returns 0 on success.
+ */
+int eval_batch(const char *filename, int nworkers, const char *outfile)
+{
+    static struct config configs[MAX_CONFIGS];
+    struct worker workers[MAX_WORKERS];
+    struct pollfd fds[MAX_WORKERS];
+    struct outcome *outcomes;
+    char line[256];
+    int nconfigs, njobs, next = 0, done = 0, i, n, fn, ok;
+    FILE* out_fp;
+
+    registerFunctions();
+    for (i = 0; i < func_counter; i++)
+        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0)
+            results.funcid = i;
+
+    if ((nconfigs = read_batch(filename, configs)) < 0) {
+        printf("Error: cannot read batch file %s\n", filename);
+        return -1;
+    }
+    njobs = nconfigs * func_counter;
+    outcomes = (struct outcome *) calloc(njobs > 0 ? njobs : 1, sizeof(struct outcome));
+    assert(outcomes);
+
+    if (nworkers > njobs)
+        nworkers = njobs;
+    for (n = 0; n < nworkers; n++) {
+        if (start_worker(&workers[n]) < 0)
+            break;
+        send_job(&workers[n], configs, next++);
+    }
+    if (n == 0 && njobs > 0) {
+        printf("Error: cannot start %s\n", SERVER);
+        free(outcomes);
+        return -1;
+    }
+    nworkers = n;
+
+    /* Each server has one job at a time, so the line read after poll
+       says it is readable is the whole of its answer */
+    while (done < njobs) {
+        for (i = 0; i < nworkers; i++) {
+            fds[i].fd = workers[i].job >= 0 ? fileno(workers[i].from) : -1;
+            fds[i].events = POLLIN;
+        }
+        if (poll(fds, nworkers, -1) < 0)
+            continue;
+
+        for (i = 0; i < nworkers; i++) {
+            struct worker *w = &workers[i];
+
+            if (w->job < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            /* Validation messages come before the result line */
+            fn = -1;
+            ok = 0;
+            while (fgets(line, sizeof(line), w->from) != NULL)
+                if (sscanf(line, "result %d %d %u %u %u", &fn, &ok,
+                           &outcomes[w->job].hits, &outcomes[w->job].misses,
+                           &outcomes[w->job].evictions) == 5)
+                    break;
+            done++;
+            if (feof(w->from) || fn != w->job % func_counter) {
+                /* The server crashed on this job: count it as incorrect
+                   and put a fresh one in its place */
+                memset(&outcomes[w->job], 0, sizeof(struct outcome));
+                printf("Function %d crashed on %dx%d\n", w->job % func_counter,
+                       configs[w->job / func_counter].M,
+                       configs[w->job / func_counter].N);
+                stop_worker(w);
+                w->job = -1;
+                if (next < njobs && start_worker(w) < 0) {
+                    printf("Error: cannot restart %s\n", SERVER);
+                    exit(1);
+                }
+            }
+            else {
+                outcomes[w->job].correct = ok;
+                w->job = -1;
+            }
+            if (next < njobs)
+                send_job(w, configs, next++);
+        }
+    }
+    for (i = 0; i < nworkers; i++)
+        if (workers[i].pid > 0)
+            stop_worker(&workers[i]);
+
+    out_fp = outfile ? fopen(outfile, "w") : stdout;
+    if (!out_fp) {
+        printf("Error: cannot write %s\n", outfile);
+        free(outcomes);
+        return -1;
+    }
+    write_report(out_fp, configs, nconfigs, outcomes);
+    if (outfile)
+        fclose(out_fp);
+    free(outcomes);
+    return 0;
+}
+
 /*
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-h] [-V] [-T] -M <rows> -N <cols>\n", argv[0]);
+    printf("       %s [-h] -B <file> [-j <workers>] [-o <file>]\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
+    printf("  -V          Trace with valgrind and simulate with csim-ref (slow)\n");
+    printf("  -T          Also time every function natively (not graded)\n");
+    printf("  -B <file>   Evaluate every function on each \"M N [s E b]\" line of <file>\n");
+    printf("  -j <n>      Batch worker processes (default: one per CPU, max %d)\n", MAX_WORKERS);
+    printf("  -o <file>   Write the batch JSON report to <file> (default: stdout)\n");
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
+    printf("Example: %s -B batch.cfg -j 4 -o results.json\n", argv[0]);
 }
 
 /*
@@ -198,8 +618,10 @@ void sigalrm_handler(int signum){
 int main(int argc, char* argv[])
 {
     char c;
+    char *batchfile = NULL, *outfile = NULL;
+    int nworkers = 0;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:VTB:j:o:h")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -207,6 +629,21 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'V':
+            use_valgrind = 1;
+            break;
+        case 'T':
+            time_funcs = 1;
+            break;
+        case 'B':
+            batchfile = optarg;
+            break;
+        case 'j':
+            nworkers = atoi(optarg);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -216,6 +653,18 @@ int main(int argc, char* argv[])
         }
     }
   
+    /* Batch mode has its shapes in the file and no time limit */
+    if (batchfile) {
+        if (nworkers <= 0)
+            nworkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (nworkers < 1)
+            nworkers = 1;
+        if (nworkers > MAX_WORKERS)
+            nworkers = MAX_WORKERS;
+        signal(SIGPIPE, SIG_IGN);
+        return eval_batch(batchfile, nworkers, outfile) == 0 ? 0 : 1;
+    }
+
     if (M == 0 || N == 0) {
         printf("Error: Missing required argument\n");
         usage(argv);
@@ -239,11 +688,21 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    /* A simulator that exits early must not kill us through the pipe */
+    signal(SIGPIPE, SIG_IGN);
+
     /* Time out and give up after a while */
     alarm(120);
 
     /* Check the performance of the student's transpose function */
     eval_perf(5, 1, 5);
+
+    /* And, if asked, how fast the functions run natively, without
+       the time limit of the graded part */
+    if (time_funcs) {
+        alarm(0);
+        eval_time();
+    }
   
     /* Emit the results for this particular test */
     if (results.funcid == -1) {
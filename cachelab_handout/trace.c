@@ -0,0 +1,423 @@
+/*
+ * trace.c - Memory-mapped, parallel trace readers for the cache simulator
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+/* chunk - one slice of a text trace and the records decoded from it */
+typedef struct _chunk {
+	const char* buf;
+	size_t len;
+	trace out;
+	int err;
+	int threaded;
+} chunk;
+
+void init_trace(trace* t)
+{
+	t->recs = NULL;
+	t->count = 0;
+	t->cap = 0;
+}
+
+void free_trace(trace* t)
+{
+	free(t->recs);
+	init_trace(t);
+}
+
+static int reserve(trace* t, size_t cap)
+{
+	trace_rec* recs;
+
+	if (cap <= t->cap) {
+		return 0;
+	}
+	recs = (trace_rec*) realloc(t->recs, sizeof(trace_rec) * cap);
+	if (recs == NULL) {
+		return -1;
+	}
+	t->recs = recs;
+	t->cap = cap;
+	return 0;
+}
+
+static int hexval(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * parse_line - Decode one line "[ ]op addr,size" in [p, eol). Returns
+ *     1 and fills rec for a memory record, 0 for any other line.
+ */
+static int parse_line(const char* p, const char* eol, trace_rec* rec)
+{
+	int digits = 0, v;
+
+	while (p < eol && *p == ' ') p++;
+	if (p == eol) {
+		return 0;
+	}
+
+	rec->op = *p++;
+	if (rec->op != 'I' && rec->op != 'L' && rec->op != 'S' && rec->op != 'M') {
+		return 0;
+	}
+	if (p == eol || *p != ' ') {
+		return 0;
+	}
+	while (p < eol && *p == ' ') p++;
+
+	rec->addr = 0;
+	while (p < eol && (v = hexval(*p)) >= 0) {
+		rec->addr = (rec->addr << 4) | (unsigned long long int)v;
+		digits++;
+		p++;
+	}
+	if (digits == 0) {
+		return 0;
+	}
+
+	rec->size = 0;
+	if (p < eol && *p == ',') {
+		for (p++; p < eol && *p >= '0' && *p <= '9'; p++) {
+			rec->size = rec->size * 10 + (unsigned int)(*p - '0');
+		}
+	}
+	return 1;
+}
+
+int parse_trace(const char* buf, size_t len, trace* t)
+{
+	const char* p = buf;
+	const char* end = buf + len;
+	const char* eol;
+
+	/* lackey lines are about 14 bytes, so this rarely has to grow */
+	if (reserve(t, t->count + len / 12 + 16) < 0) {
+		return -1;
+	}
+
+	for (; p < end; p = eol + 1) {
+		eol = memchr(p, '\n', (size_t)(end - p));
+		if (eol == NULL) {
+			eol = end;
+		}
+		if (t->count == t->cap && reserve(t, t->cap * 2) < 0) {
+			return -1;
+		}
+		if (parse_line(p, eol, &t->recs[t->count])) {
+			t->count++;
+		}
+	}
+	return 0;
+}
+
+static unsigned long long int get_le64(const unsigned char* p)
+{
+	unsigned long long int v = 0;
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+static void put_le64(unsigned char* p, unsigned long long int v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		p[i] = (unsigned char)(v >> (8 * i));
+	}
+}
+
+/*
+ * fill_stream - Top up buf (holding *have bytes) from fd. Returns the
+ *     number of bytes read, 0 at end of input, -1 on error.
+ */
+static ssize_t fill_stream(int fd, char* buf, size_t* have)
+{
+	ssize_t n;
+
+	do {
+		n = read(fd, buf + *have, TRACE_STREAM_BUF - *have);
+	} while (n < 0 && errno == EINTR);
+	if (n > 0) {
+		*have += (size_t) n;
+	}
+	return n;
+}
+
+int stream_trace(int fd, void (*fn)(const trace_rec* rec, void* arg), void* arg)
+{
+	static char buf[TRACE_STREAM_BUF];
+	size_t have = 0, used;
+	int binary = -1, eof = 0, overlong = 0;
+	trace_rec rec;
+	char* p;
+	char* eol;
+
+	while (!eof) {
+		ssize_t n = fill_stream(fd, buf, &have);
+
+		if (n < 0) {
+			return -1;
+		}
+		eof = (n == 0);
+
+		if (binary == -1) {
+			if (have < TRACE_HEADER_LEN && !eof) {
+				continue;
+			}
+			binary = have >= TRACE_HEADER_LEN &&
+				memcmp(buf, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0;
+			if (binary) {
+				/* the record count is not needed when streaming */
+				memmove(buf, buf + TRACE_HEADER_LEN, have - TRACE_HEADER_LEN);
+				have -= TRACE_HEADER_LEN;
+			}
+		}
+
+		used = 0;
+		if (binary) {
+			for (; have - used >= TRACE_RECORD_LEN; used += TRACE_RECORD_LEN) {
+				const unsigned char* r = (const unsigned char*) buf + used;
+
+				rec.addr = get_le64(r);
+				rec.size = r[8];
+				rec.op = (char) r[9];
+				fn(&rec, arg);
+			}
+		}
+		else {
+			for (p = buf; (eol = memchr(p, '\n', have - (size_t)(p - buf))) != NULL; p = eol + 1) {
+				if (!overlong && parse_line(p, eol, &rec)) {
+					fn(&rec, arg);
+				}
+				overlong = 0;
+			}
+			used = (size_t)(p - buf);
+			if (eof && used < have) {
+				if (!overlong && parse_line(p, buf + have, &rec)) {
+					fn(&rec, arg);
+				}
+				used = have;
+			}
+			else if (used == 0 && have == TRACE_STREAM_BUF) {
+				/* no record is this long; drop the line up to its newline */
+				overlong = 1;
+				used = have;
+			}
+		}
+
+		memmove(buf, buf + used, have - used);
+		have -= used;
+	}
+	return 0;
+}
+
+static void* parse_chunk(void* arg)
+{
+	chunk* c = (chunk*) arg;
+
+	c->err = parse_trace(c->buf, c->len, &c->out);
+	return NULL;
+}
+
+/*
+ * parse_parallel - Split buf at line boundaries into up to nthreads
+ *     chunks, decode them concurrently and append them to t in order
+ */
+static int parse_parallel(const char* buf, size_t len, int nthreads, trace* t)
+{
+	chunk* chunks;
+	pthread_t* tids;
+	size_t start, stop, total;
+	int i, n, err = 0;
+
+	if (nthreads <= 0) {
+		nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	n = (int)(len / TRACE_MIN_CHUNK);
+	if (n > nthreads) n = nthreads;
+	if (n <= 1) {
+		return parse_trace(buf, len, t);
+	}
+
+	chunks = (chunk*) calloc((size_t)n, sizeof(chunk));
+	tids = (pthread_t*) calloc((size_t)n, sizeof(pthread_t));
+	if (chunks == NULL || tids == NULL) {
+		free(chunks);
+		free(tids);
+		return -1;
+	}
+
+	/* every chunk after the first starts right after a newline */
+	start = 0;
+	for (i = 0; i < n; i++) {
+		stop = (i == n - 1) ? len : len / (size_t)n * (size_t)(i + 1);
+		while (stop < len && buf[stop - 1] != '\n') {
+			stop++;
+		}
+		if (stop < start) {
+			stop = start;
+		}
+		chunks[i].buf = buf + start;
+		chunks[i].len = stop - start;
+		init_trace(&chunks[i].out);
+		start = stop;
+	}
+
+	for (i = 1; i < n; i++) {
+		chunks[i].threaded = pthread_create(&tids[i], NULL, parse_chunk, &chunks[i]) == 0;
+		if (!chunks[i].threaded) {
+			/* decode it on this thread instead */
+			parse_chunk(&chunks[i]);
+		}
+	}
+	parse_chunk(&chunks[0]);
+	for (i = 1; i < n; i++) {
+		if (chunks[i].threaded) {
+			pthread_join(tids[i], NULL);
+		}
+	}
+
+	total = t->count;
+	for (i = 0; i < n; i++) {
+		err |= chunks[i].err;
+		total += chunks[i].out.count;
+	}
+	if (err == 0 && reserve(t, total) == 0) {
+		for (i = 0; i < n; i++) {
+			memcpy(t->recs + t->count, chunks[i].out.recs,
+					sizeof(trace_rec) * chunks[i].out.count);
+			t->count += chunks[i].out.count;
+		}
+	}
+	else {
+		err = -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		free_trace(&chunks[i].out);
+	}
+	free(chunks);
+	free(tids);
+	return err ? -1 : 0;
+}
+
+static int load_binary(const unsigned char* buf, size_t len, trace* t)
+{
+	unsigned long long int count = get_le64(buf + TRACE_MAGIC_LEN);
+	const unsigned char* p = buf + TRACE_HEADER_LEN;
+	size_t i;
+
+	if (count > (len - TRACE_HEADER_LEN) / TRACE_RECORD_LEN) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (reserve(t, t->count + (size_t)count) < 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+	for (i = 0; i < count; i++, p += TRACE_RECORD_LEN) {
+		trace_rec* rec = &t->recs[t->count++];
+
+		rec->addr = get_le64(p);
+		rec->size = p[8];
+		rec->op = (char) p[9];
+	}
+	return 0;
+}
+
+int read_trace(const char* filename, int nthreads, trace* t)
+{
+	struct stat st;
+	void* map;
+	size_t len;
+	int fd, res;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+	len = (size_t) st.st_size;
+	if (len == 0) {
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	madvise(map, len, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+	if (len >= TRACE_HEADER_LEN && memcmp(map, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+		res = load_binary((const unsigned char*) map, len, t);
+	}
+	else {
+		res = parse_parallel((const char*) map, len, nthreads, t);
+		if (res < 0) {
+			errno = ENOMEM;
+		}
+	}
+
+	munmap(map, len);
+	return res;
+}
+
+int write_binary_trace(const char* filename, const trace* t)
+{
+	unsigned char buf[TRACE_RECORD_LEN * 4096];
+	size_t i, used = 0;
+	FILE* out = fopen(filename, "wb");
+
+	if (out == NULL) {
+		return -1;
+	}
+
+	memcpy(buf, TRACE_MAGIC, TRACE_MAGIC_LEN);
+	put_le64(buf + TRACE_MAGIC_LEN, (unsigned long long int) t->count);
+	if (fwrite(buf, 1, TRACE_HEADER_LEN, out) != TRACE_HEADER_LEN) {
+		fclose(out);
+		return -1;
+	}
+
+	for (i = 0; i < t->count; i++) {
+		const trace_rec* rec = &t->recs[i];
+
+		put_le64(buf + used, rec->addr);
+		buf[used + 8] = (unsigned char)(rec->size > 255 ? 255 : rec->size);
+		buf[used + 9] = (unsigned char) rec->op;
+		used += TRACE_RECORD_LEN;
+		if (used == sizeof(buf) || i == t->count - 1) {
+			if (fwrite(buf, 1, used, out) != used) {
+				fclose(out);
+				return -1;
+			}
+			used = 0;
+		}
+	}
+	return fclose(out) == 0 ? 0 : -1;
+}
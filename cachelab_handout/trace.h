@@ -0,0 +1,76 @@
+/*
+ * trace.h - Trace readers for the cache simulator
+ *
+ * Text traces (valgrind lackey format, " L 04f6b868,8") are mapped into
+ * memory, cut into chunks at line boundaries and decoded by several
+ * threads into one array of trace records, kept in trace order. Binary
+ * traces written by write_binary_trace() are recognized by their magic
+ * and loaded without parsing.
+ */
+
+#ifndef CSIM_TRACE_H
+#define CSIM_TRACE_H
+
+#include <stddef.h>
+
+/* Binary trace layout: magic, record count (8 bytes LE), records */
+#define TRACE_MAGIC "CSIMTRC1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_HEADER_LEN 16
+
+/* Each binary record: addr (8 bytes LE), size (1 byte), op (1 byte) */
+#define TRACE_RECORD_LEN 10
+
+/* Bytes of a piped trace held in memory at any time */
+#define TRACE_STREAM_BUF (1 << 16)
+
+/* Chunks smaller than this are not worth a thread of their own */
+#define TRACE_MIN_CHUNK (1 << 20)
+
+typedef struct _trace_rec {
+	unsigned long long int addr;
+	unsigned int size;
+	char op;		/* 'I', 'L', 'S' or 'M' */
+} trace_rec;
+
+typedef struct _trace {
+	trace_rec* recs;
+	size_t count;
+	size_t cap;
+} trace;
+
+/*
+ * read_trace - Load the text or binary trace in filename into t using
+ *     up to nthreads decoder threads (0 picks one per online CPU).
+ *     Returns 0 on success and -1 with errno set on failure.
+ */
+int read_trace(const char* filename, int nthreads, trace* t);
+
+/*
+ * stream_trace - Decode the text or binary trace arriving on fd through
+ *     a fixed TRACE_STREAM_BUF buffer, calling fn on each record as soon
+ *     as it is complete. Returns 0 at end of input and -1 with errno set
+ *     on a read error.
+ */
+int stream_trace(int fd, void (*fn)(const trace_rec* rec, void* arg), void* arg);
+
+/*
+ * parse_trace - Decode len bytes of text trace starting at buf,
+ *     appending the records to t. Lines that are not I/L/S/M records
+ *     are skipped. Returns 0 on success, -1 if out of memory.
+ */
+int parse_trace(const char* buf, size_t len, trace* t);
+
+/*
+ * write_binary_trace - Save t in the compact binary format. Returns 0
+ *     on success and -1 with errno set on failure.
+ */
+int write_binary_trace(const char* filename, const trace* t);
+
+/* init_trace - Start an empty trace */
+void init_trace(trace* t);
+
+/* free_trace - Release the records of t */
+void free_trace(trace* t);
+
+#endif /* CSIM_TRACE_H */
@@ -5,6 +5,20 @@
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
  * addresses are recorded in file for later use.
+ *
+ * Given -s, -E and -b, tracegen instead simulates the cache itself:
+ * it links an instrumented build of trans.c whose accesses to A and B
+ * feed an in-process cache model (see instrument.h), and reports the
+ * counts with printSummary like csim does. tracegen-valgrind is built
+ * from the same source with the plain trans.o, for tracing with
+ * valgrind.
+ *
+ * With -L and -z it runs layout function L on elements of z bytes
+ * instead, simulated the same way given -s, -E and -b.
+ *
+ * With -S it serves test-trans's batch mode: it reads jobs
+ * "M N F s E b" from stdin and answers each with one line
+ * "result F correct hits misses evictions" on stdout.
  */
 
 #include <stdlib.h>
@@ -13,14 +27,19 @@
 #include <unistd.h>
 #include <getopt.h>
 #include "cachelab.h"
+#include "cachemodel.h"
+#include "instrument.h"
 #include <string.h>
 
 /* External variables declared in cachelab.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
 extern int func_counter; 
+extern layout_func_t layout_list[MAX_LAYOUT_FUNCS];
+extern int layout_counter;
 
-/* External function from trans.c */
+/* External function and variable from trans.c */
 extern void registerFunctions();
+extern int trans_workers;
 
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
@@ -30,6 +49,14 @@ static int B[256][256];
 static int M;
 static int N;
 
+/* Matrices of the layout functions, and the expected result */
+static unsigned char LA[256 * 256 * MAX_ELEM_SIZE];
+static unsigned char LB[256 * 256 * MAX_ELEM_SIZE];
+static unsigned char LC[256 * 256 * MAX_ELEM_SIZE];
+
+/* The in-process cache, if one was asked for */
+static cache_model* model = NULL;
+
 
 int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     int C[M][N];
@@ -46,12 +73,100 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * run - Run transpose function fn between the markers, simulating its
+ *     accesses if there is a model. Returns 0 if it failed validation.
+ */
+int run(int fn) {
+    if (model) {
+        reset_cache_model(model);
+        start_recording(model, A, sizeof(int) * M * N, B, sizeof(int) * M * N);
+    }
+    MARKER_START = 33;
+    (*func_list[fn].func_ptr)(M, N, A, B);
+    MARKER_END = 34;
+    if (model) {
+        stop_recording();
+    }
+
+    return validate(fn,M,N,A,B);
+}
+
+/*
+ * report - Print the simulated counts of function fn, if any
+ */
+void report(int fn) {
+    if (model) {
+        printf("func %d (%s): ", fn, func_list[fn].description);
+        printSummary(model->hits, model->misses, model->evictions);
+    }
+}
+
+/*
+ * run_layout - Run layout function fn on size-byte elements between
+ *     the markers, like run. Returns 0 if it failed validation.
+ */
+int run_layout(int fn, size_t size) {
+    size_t len = (size_t) M * N * size;
+
+    if (model) {
+        reset_cache_model(model);
+        start_recording(model, LA, len, LB, len);
+    }
+    MARKER_START = 33;
+    (*layout_list[fn].func_ptr)(M, N, size, LA, LB);
+    MARKER_END = 34;
+    if (model) {
+        stop_recording();
+    }
+
+    correctLayout(layout_list[fn].kind, M, N, size, LA, LC);
+    if (memcmp(LB, LC, len) != 0) {
+        printf("Validation failed on layout function %d with %zu-byte elements!\n", fn, size);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * serve - Answer batch jobs from stdin until it is closed, keeping the
+ *     model while the cache geometry stays the same
+ */
+void serve() {
+    char line[256];
+    int fn, s, E, b, ok;
+
+    trans_workers = 1;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (sscanf(line, "%d %d %d %d %d %d", &M, &N, &fn, &s, &E, &b) != 6 ||
+            M <= 0 || N <= 0 || M > 256 || N > 256 || fn < 0 || fn >= func_counter ||
+            s < 0 || s > 20 || E < 1 || b < 2 || b > 20) {
+            printf("result -1 0 0 0 0\n");
+            fflush(stdout);
+            continue;
+        }
+        if (model && (model->s != s || model->E != E || model->b != b)) {
+            free_cache_model(model);
+            model = NULL;
+        }
+        if (!model)
+            model = new_cache_model(s, E, b, find_policy("lru"));
+
+        initMatrix(M, N, A, B);
+        ok = run(fn);
+        printf("result %d %d %u %u %u\n", fn, ok, model->hits, model->misses, model->evictions);
+        fflush(stdout);
+    }
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    int s=-1, E=-1, b=-1, server=0;
+    int selectedLayout=-1, size=sizeof(int);
+    while( (c=getopt(argc,argv,"M:N:F:L:z:s:E:b:S")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,6 +177,24 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'L':
+            selectedLayout = atoi(optarg);
+            break;
+        case 'z':
+            size = atoi(optarg);
+            break;
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'S':
+            server = 1;
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -73,6 +206,37 @@ int main(int argc, char* argv[]){
     /*  Register transpose functions */
     registerFunctions();
 
+    if (server) {
+        serve();
+        return 0;
+    }
+
+    /* The model follows one thread, and a serial order is repeatable */
+    if (s >= 0 && E > 0 && b >= 0) {
+        model = new_cache_model(s, E, b, find_policy("lru"));
+        trans_workers = 1;
+    }
+
+    if (selectedLayout >= 0) {
+        if (selectedLayout >= layout_counter || !ELEM_SIZE_OK(size) ||
+            (layout_list[selectedLayout].elem_size != 0 &&
+             layout_list[selectedLayout].elem_size != size) ||
+            M <= 0 || N <= 0 || M > 256 || N > 256) {
+            printf("./tracegen cannot run layout function %d on %dx%d %d-byte elements.\n",
+                   selectedLayout, M, N, size);
+            exit(1);
+        }
+        initLayout(M, N, size, LA);
+        if (!run_layout(selectedLayout, size))
+            return selectedLayout+1;
+        if (model) {
+            printf("layout %d (%s, %d-byte): ", selectedLayout,
+                   layout_list[selectedLayout].description, size);
+            printSummary(model->hits, model->misses, model->evictions);
+        }
+        return 0;
+    }
+
     /* Fill A with data */
     initMatrix(M,N, A, B); 
 
@@ -84,22 +248,25 @@ int main(int argc, char* argv[]){
             (unsigned long long int) &MARKER_END );
     fclose(marker_fp);
 
+    /* Record where the matrices live, for csim -m */
+    FILE* regions_fp = fopen(".regions","w");
+    assert(regions_fp);
+    fprintf(regions_fp, "A %llx %d %d\nB %llx %d %d\n",
+            (unsigned long long int) A, N, M * (int) sizeof(int),
+            (unsigned long long int) B, M, N * (int) sizeof(int));
+    fclose(regions_fp);
+
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            if (!run(i))
                 return i+1;
+            report(i);
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        if (!run(selectedFunc))
             return selectedFunc+1;
-
+        report(selectedFunc);
     }
     return 0;
 }
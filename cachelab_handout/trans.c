@@ -4,13 +4,47 @@
  * Each transpose function must have a prototype of the form:
  * void trans(int M, int N, int A[N][M], int B[M][N]);
  *
+ * Layout functions convert matrices of elements of any of 1 to 16
+ * bytes, and have a prototype of the form:
+ * void layout(int M, int N, size_t size, const void *A, void *B);
+ *
  * A transpose function is evaluated by counting the number of misses
  * on a 1KB direct mapped cache with a block size of 32 bytes.
  */ 
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <immintrin.h>
 #include "cachelab.h"
 
 int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+void trans_tiled(int M, int N, int A[N][M], int B[M][N]);
+
+/* Workers used by the parallel transposes; 0 means one per CPU */
+int trans_workers = 0;
+
+/*
+ * Geometry of the cache the functions are evaluated on: 2^CACHE_S sets
+ * of CACHE_E lines holding 2^CACHE_B bytes. Keep these in step with the
+ * eval_perf call in test-trans.c.
+ */
+#define CACHE_S 5
+#define CACHE_E 1
+#define CACHE_B 5
+
+/* Block and set of the int at index x of a block-aligned matrix */
+#define BLOCK_OF(x) ((int)(((x) * sizeof(int)) >> CACHE_B))
+#define SET_OF(x) (BLOCK_OF(x) & ((1 << CACHE_S) - 1))
+
+/* Below this many rows and columns trans_recursive stops splitting */
+#define RECURSE_BASE 8
+
+/* Tile side of the parallel transposes (a multiple of 8), and the most
+   workers they start */
+#define PAR_TILE 64
+#define MAX_WORKERS 64
+#define CACHE_LINE 64
 
 /* 
  * transpose_submit - This is the solution transpose function that you
@@ -22,7 +56,7 @@ int is_transpose(int M, int N, int A[N][M], int B[M][N]);
 char transpose_submit_desc[] = "Transpose submission";
 void transpose_submit(int M, int N, int A[N][M], int B[M][N])
 {
-	if (M <= 32 && N <= 32) {
+	if (M == 32 && N == 32) {
 		int i, j, k, l;
 
 		for (i = 0; i < N; i+= 8) {
@@ -98,7 +132,7 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
 	}
 	else {
 		int i, j, k, l;
-		
+
 		for (i = 0; i < N; i+= 16) {
 			for (j = 0; j < M; j+= 16) {
 				for (k = i; (k < i + 16) && k < N; k++) {
@@ -133,6 +167,713 @@ void trans(int M, int N, int A[N][M], int B[M][N])
 
 }
 
+/*
+ * tile_size - Side of the square tiles trans_tiled uses when B has rows
+ *     of N ints. While a tile row of A is copied, the tile's rows of B
+ *     must all stay cached, so the side is the largest power of 2 whose
+ *     B rows, plus the A row, fit in the cache with no more than
+ *     CACHE_E distinct blocks of B rows falling into one set.
+ */
+static int tile_size(int N)
+{
+	int perblock = (1 << CACHE_B) / sizeof(int);
+	int lines = (1 << CACHE_S) * CACHE_E;
+	int t, r, other, same, fits;
+
+	for (t = lines; t > 1; t /= 2) {
+		if (t + (t + perblock - 1) / perblock > lines) {
+			continue;
+		}
+		fits = 1;
+		for (r = 1; r < t && fits; r++) {
+			same = 0;
+			for (other = 0; other < r; other++) {
+				if (BLOCK_OF(r * N) != BLOCK_OF(other * N) &&
+						SET_OF(r * N) == SET_OF(other * N)) {
+					same++;
+				}
+			}
+			fits = same < CACHE_E;
+		}
+		if (fits) {
+			return t;
+		}
+	}
+	return 1;
+}
+
+/*
+ * trans_tiled - Blocked transpose for any M x N with the tile size
+ *     derived from the cache geometry. The diagonal element of a row is
+ *     copied last, as in a diagonal tile A[k][k] and B[k][k] share a set.
+ */
+char trans_tiled_desc[] = "Tiled transpose, tile from s/E/b";
+void trans_tiled(int M, int N, int A[N][M], int B[M][N])
+{
+	int t = tile_size(N);
+	int i, j, k, l, diag;
+
+	for (i = 0; i < N; i += t) {
+		for (j = 0; j < M; j += t) {
+			for (k = i; k < i + t && k < N; k++) {
+				diag = -1;
+				for (l = j; l < j + t && l < M; l++) {
+					if (k == l) {
+						diag = l;
+					}
+					else {
+						B[l][k] = A[k][l];
+					}
+				}
+				if (diag != -1) {
+					B[diag][k] = A[k][diag];
+				}
+			}
+		}
+	}
+}
+
+/*
+ * recurse - Transpose rows [r0, r1) and columns [c0, c1) of A by
+ *     halving the longer side until the piece is small
+ */
+static void recurse(int M, int N, int A[N][M], int B[M][N],
+		int r0, int r1, int c0, int c1)
+{
+	int i, j;
+
+	if (r1 - r0 <= RECURSE_BASE && c1 - c0 <= RECURSE_BASE) {
+		for (i = r0; i < r1; i++) {
+			for (j = c0; j < c1; j++) {
+				B[j][i] = A[i][j];
+			}
+		}
+	}
+	else if (r1 - r0 >= c1 - c0) {
+		recurse(M, N, A, B, r0, r0 + (r1 - r0) / 2, c0, c1);
+		recurse(M, N, A, B, r0 + (r1 - r0) / 2, r1, c0, c1);
+	}
+	else {
+		recurse(M, N, A, B, r0, r1, c0, c0 + (c1 - c0) / 2);
+		recurse(M, N, A, B, r0, r1, c0 + (c1 - c0) / 2, c1);
+	}
+}
+
+/*
+ * trans_recursive - Cache-oblivious divide-and-conquer transpose: it
+ *     knows nothing of the cache, yet at some depth the pieces of A
+ *     and B fit in it, whatever its size
+ */
+char trans_recursive_desc[] = "Cache-oblivious recursive transpose";
+void trans_recursive(int M, int N, int A[N][M], int B[M][N])
+{
+	recurse(M, N, A, B, 0, N, 0, M);
+}
+
+/*
+ * transpose_edges - Scalar copy of the rows at or past row0 and the
+ *     columns at or past col0, which the SIMD kernels' tiles leave out
+ */
+static void transpose_edges(int M, int N, int A[N][M], int B[M][N],
+		int row0, int col0)
+{
+	int i, j;
+
+	for (i = 0; i < N; i++) {
+		for (j = (i < row0 ? col0 : 0); j < M; j++) {
+			B[j][i] = A[i][j];
+		}
+	}
+}
+
+/*
+ * transpose4x4_sse - Transpose the 4x4 tile of A at (i, j) into B in
+ *     registers: two rounds of unpacks interleave 32-bit then 64-bit
+ *     pieces of the rows into the columns
+ */
+__attribute__((target("sse2")))
+static void transpose4x4_sse(int M, int N, int A[N][M], int B[M][N], int i, int j)
+{
+	__m128i r0 = _mm_loadu_si128((__m128i*) &A[i][j]);
+	__m128i r1 = _mm_loadu_si128((__m128i*) &A[i+1][j]);
+	__m128i r2 = _mm_loadu_si128((__m128i*) &A[i+2][j]);
+	__m128i r3 = _mm_loadu_si128((__m128i*) &A[i+3][j]);
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1);	/* a0 b0 a1 b1 */
+	__m128i t1 = _mm_unpackhi_epi32(r0, r1);	/* a2 b2 a3 b3 */
+	__m128i t2 = _mm_unpacklo_epi32(r2, r3);	/* c0 d0 c1 d1 */
+	__m128i t3 = _mm_unpackhi_epi32(r2, r3);	/* c2 d2 c3 d3 */
+
+	_mm_storeu_si128((__m128i*) &B[j][i], _mm_unpacklo_epi64(t0, t2));
+	_mm_storeu_si128((__m128i*) &B[j+1][i], _mm_unpackhi_epi64(t0, t2));
+	_mm_storeu_si128((__m128i*) &B[j+2][i], _mm_unpacklo_epi64(t1, t3));
+	_mm_storeu_si128((__m128i*) &B[j+3][i], _mm_unpackhi_epi64(t1, t3));
+}
+
+/*
+ * trans_sse - 8x8 tiles, each moved as four in-register 4x4 transposes
+ */
+char trans_sse_desc[] = "SSE 4x4 in-register transpose";
+void trans_sse(int M, int N, int A[N][M], int B[M][N])
+{
+	int i, j;
+
+	for (i = 0; i + 8 <= N; i += 8) {
+		for (j = 0; j + 8 <= M; j += 8) {
+			transpose4x4_sse(M, N, A, B, i, j);
+			transpose4x4_sse(M, N, A, B, i, j + 4);
+			transpose4x4_sse(M, N, A, B, i + 4, j);
+			transpose4x4_sse(M, N, A, B, i + 4, j + 4);
+		}
+	}
+	transpose_edges(M, N, A, B, N & ~7, M & ~7);
+}
+
+/*
+ * transpose8x8_avx2 - Transpose the 8x8 tile of A at (i, j) into B in
+ *     registers. Unpacks within the 128-bit lanes build 4x4 transposes
+ *     in each lane, and a cross-lane permute joins the halves.
+ */
+__attribute__((target("avx2")))
+static void transpose8x8_avx2(int M, int N, int A[N][M], int B[M][N], int i, int j)
+{
+	__m256i r0 = _mm256_loadu_si256((__m256i*) &A[i][j]);
+	__m256i r1 = _mm256_loadu_si256((__m256i*) &A[i+1][j]);
+	__m256i r2 = _mm256_loadu_si256((__m256i*) &A[i+2][j]);
+	__m256i r3 = _mm256_loadu_si256((__m256i*) &A[i+3][j]);
+	__m256i r4 = _mm256_loadu_si256((__m256i*) &A[i+4][j]);
+	__m256i r5 = _mm256_loadu_si256((__m256i*) &A[i+5][j]);
+	__m256i r6 = _mm256_loadu_si256((__m256i*) &A[i+6][j]);
+	__m256i r7 = _mm256_loadu_si256((__m256i*) &A[i+7][j]);
+	__m256i t0, t1, t2, t3, t4, t5, t6, t7;
+
+	/* a0 b0 a1 b1 | a4 b4 a5 b5 and so on */
+	t0 = _mm256_unpacklo_epi32(r0, r1);
+	t1 = _mm256_unpackhi_epi32(r0, r1);
+	t2 = _mm256_unpacklo_epi32(r2, r3);
+	t3 = _mm256_unpackhi_epi32(r2, r3);
+	t4 = _mm256_unpacklo_epi32(r4, r5);
+	t5 = _mm256_unpackhi_epi32(r4, r5);
+	t6 = _mm256_unpacklo_epi32(r6, r7);
+	t7 = _mm256_unpackhi_epi32(r6, r7);
+
+	/* a0 b0 c0 d0 | a4 b4 c4 d4 and so on */
+	r0 = _mm256_unpacklo_epi64(t0, t2);
+	r1 = _mm256_unpackhi_epi64(t0, t2);
+	r2 = _mm256_unpacklo_epi64(t1, t3);
+	r3 = _mm256_unpackhi_epi64(t1, t3);
+	r4 = _mm256_unpacklo_epi64(t4, t6);
+	r5 = _mm256_unpackhi_epi64(t4, t6);
+	r6 = _mm256_unpacklo_epi64(t5, t7);
+	r7 = _mm256_unpackhi_epi64(t5, t7);
+
+	_mm256_storeu_si256((__m256i*) &B[j][i], _mm256_permute2x128_si256(r0, r4, 0x20));
+	_mm256_storeu_si256((__m256i*) &B[j+1][i], _mm256_permute2x128_si256(r1, r5, 0x20));
+	_mm256_storeu_si256((__m256i*) &B[j+2][i], _mm256_permute2x128_si256(r2, r6, 0x20));
+	_mm256_storeu_si256((__m256i*) &B[j+3][i], _mm256_permute2x128_si256(r3, r7, 0x20));
+	_mm256_storeu_si256((__m256i*) &B[j+4][i], _mm256_permute2x128_si256(r0, r4, 0x31));
+	_mm256_storeu_si256((__m256i*) &B[j+5][i], _mm256_permute2x128_si256(r1, r5, 0x31));
+	_mm256_storeu_si256((__m256i*) &B[j+6][i], _mm256_permute2x128_si256(r2, r6, 0x31));
+	_mm256_storeu_si256((__m256i*) &B[j+7][i], _mm256_permute2x128_si256(r3, r7, 0x31));
+}
+
+/*
+ * trans_avx2 - 8x8 tiles transposed in registers; a whole tile of A is
+ *     read before any of B is written, so A and B tiles sharing sets
+ *     cannot evict each other. Falls back to trans_sse without AVX2.
+ */
+char trans_avx2_desc[] = "AVX2 8x8 in-register transpose";
+void trans_avx2(int M, int N, int A[N][M], int B[M][N])
+{
+	int i, j;
+
+	if (!__builtin_cpu_supports("avx2")) {
+		trans_sse(M, N, A, B);
+		return;
+	}
+	for (i = 0; i + 8 <= N; i += 8) {
+		for (j = 0; j + 8 <= M; j += 8) {
+			transpose8x8_avx2(M, N, A, B, i, j);
+		}
+	}
+	transpose_edges(M, N, A, B, N & ~7, M & ~7);
+}
+
+/*
+ * The parallel transposes number their tiles (or tile pairs) and give
+ * every worker a contiguous range of them, so a worker's tiles form a
+ * band of rows; memory first touched by the same band partition stays
+ * local to that worker on NUMA machines. A worker takes tiles from the
+ * front of its range and, once it is empty, steals from the back of the
+ * others'. A range is one 64-bit word, lo in the low half and hi in the
+ * high half, so owner and thieves claim tiles with the same CAS.
+ */
+typedef struct _tile_range {
+	unsigned long long int range;
+	char pad[CACHE_LINE - sizeof(unsigned long long int)];
+} tile_range;
+
+typedef struct _tile_job {
+	void (*run)(struct _tile_job *job, int tile);
+	int M, N;
+	void *A, *B;
+	int tiles;			/* tiles across a row of A */
+	int nworkers;
+	tile_range ranges[MAX_WORKERS];
+} tile_job;
+
+typedef struct _worker {
+	tile_job *job;
+	int id;
+} worker;
+
+/*
+ * claim - Take one tile from the front (own range) or back (stolen) of
+ *     r. Returns the tile, or -1 if the range is empty.
+ */
+static int claim(tile_range *r, int steal)
+{
+	unsigned long long int old = __atomic_load_n(&r->range, __ATOMIC_ACQUIRE);
+	unsigned long long int lo, hi;
+
+	for (;;) {
+		lo = old & 0xffffffffULL;
+		hi = old >> 32;
+		if (lo >= hi) {
+			return -1;
+		}
+		if (steal) {
+			hi--;
+		}
+		else {
+			lo++;
+		}
+		if (__atomic_compare_exchange_n(&r->range, &old, (hi << 32) | lo, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return (int)(steal ? hi : lo - 1);
+		}
+	}
+}
+
+static void *work(void *arg)
+{
+	worker *w = (worker*) arg;
+	tile_job *job = w->job;
+	int tile, victim, stolen;
+
+	while ((tile = claim(&job->ranges[w->id], 0)) != -1) {
+		job->run(job, tile);
+	}
+	/* no tiles are added once the job runs, so a pass that steals
+	   nothing means all are taken */
+	do {
+		stolen = 0;
+		for (victim = 1; victim < job->nworkers; victim++) {
+			int v = (w->id + victim) % job->nworkers;
+
+			while ((tile = claim(&job->ranges[v], 1)) != -1) {
+				job->run(job, tile);
+				stolen = 1;
+			}
+		}
+	} while (stolen);
+	return NULL;
+}
+
+/*
+ * run_tiles - Run tiles 0 .. count-1 of job on the workers and wait
+ *     for all of them; the calling thread is worker 0
+ */
+static void run_tiles(tile_job *job, int count)
+{
+	pthread_t tids[MAX_WORKERS];
+	worker workers[MAX_WORKERS];
+	int started[MAX_WORKERS];
+	long long int lo, hi;
+	int i;
+
+	job->nworkers = trans_workers > 0 ? trans_workers : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (job->nworkers > MAX_WORKERS) job->nworkers = MAX_WORKERS;
+	if (job->nworkers > count) job->nworkers = count;
+	if (job->nworkers < 1) job->nworkers = 1;
+
+	for (i = 0; i < job->nworkers; i++) {
+		lo = (long long int) count * i / job->nworkers;
+		hi = (long long int) count * (i + 1) / job->nworkers;
+		job->ranges[i].range = ((unsigned long long int) hi << 32) | (unsigned long long int) lo;
+		workers[i].job = job;
+		workers[i].id = i;
+	}
+	for (i = 1; i < job->nworkers; i++) {
+		/* a worker that cannot start leaves its range to be stolen */
+		started[i] = pthread_create(&tids[i], NULL, work, &workers[i]) == 0;
+	}
+	work(&workers[0]);
+	for (i = 1; i < job->nworkers; i++) {
+		if (started[i]) {
+			pthread_join(tids[i], NULL);
+		}
+	}
+}
+
+/* copy_tile - B = A^T for one PAR_TILE tile of A, in 8x8 kernels */
+static void copy_tile(tile_job *job, int tile)
+{
+	int M = job->M, N = job->N;
+	int (*A)[M] = (int (*)[M]) job->A;
+	int (*B)[N] = (int (*)[N]) job->B;
+	int i0 = tile / job->tiles * PAR_TILE, j0 = tile % job->tiles * PAR_TILE;
+	int i1 = i0 + PAR_TILE < N ? i0 + PAR_TILE : N;
+	int j1 = j0 + PAR_TILE < M ? j0 + PAR_TILE : M;
+	int avx2 = __builtin_cpu_supports("avx2");
+	int i, j, k, l;
+
+	for (i = i0; i < i1; i += 8) {
+		for (j = j0; j < j1; j += 8) {
+			if (avx2 && i + 8 <= i1 && j + 8 <= j1) {
+				transpose8x8_avx2(M, N, A, B, i, j);
+				continue;
+			}
+			for (k = i; k < i + 8 && k < i1; k++) {
+				for (l = j; l < j + 8 && l < j1; l++) {
+					B[l][k] = A[k][l];
+				}
+			}
+		}
+	}
+}
+
+/*
+ * trans_parallel - Tiled transpose spread over trans_workers threads
+ *     with work stealing
+ */
+char trans_parallel_desc[] = "Multi-threaded tiled transpose";
+void trans_parallel(int M, int N, int A[N][M], int B[M][N])
+{
+	tile_job job;
+
+	job.run = copy_tile;
+	job.M = M;
+	job.N = N;
+	job.A = A;
+	job.B = B;
+	job.tiles = (M + PAR_TILE - 1) / PAR_TILE;
+	run_tiles(&job, job.tiles * ((N + PAR_TILE - 1) / PAR_TILE));
+}
+
+/*
+ * swap_tiles - In-place transpose of one tile pair of the square
+ *     matrix: the pair is numbered row by row over the upper triangle
+ *     of tiles. A diagonal tile is transposed within itself; an
+ *     off-diagonal tile trades places with its mirror, transposed.
+ */
+static void swap_tiles(tile_job *job, int pair)
+{
+	int N = job->N;
+	int (*A)[N] = (int (*)[N]) job->A;
+	int bi = 0, bj, i, j, i1, j1, tmp;
+
+	while (pair >= job->tiles - bi) {
+		pair -= job->tiles - bi;
+		bi++;
+	}
+	bj = bi + pair;
+	i1 = (bi + 1) * PAR_TILE < N ? (bi + 1) * PAR_TILE : N;
+	j1 = (bj + 1) * PAR_TILE < N ? (bj + 1) * PAR_TILE : N;
+
+	for (i = bi * PAR_TILE; i < i1; i++) {
+		for (j = (bi == bj ? i + 1 : bj * PAR_TILE); j < j1; j++) {
+			tmp = A[i][j];
+			A[i][j] = A[j][i];
+			A[j][i] = tmp;
+		}
+	}
+}
+
+/*
+ * transpose_inplace - A = A^T for a square N x N matrix, with the tile
+ *     pairs spread over trans_workers threads. Each pair is owned by
+ *     one worker, so no two workers touch the same elements.
+ */
+void transpose_inplace(int N, int A[N][N])
+{
+	tile_job job;
+
+	job.run = swap_tiles;
+	job.M = N;
+	job.N = N;
+	job.A = A;
+	job.B = NULL;
+	job.tiles = (N + PAR_TILE - 1) / PAR_TILE;
+	run_tiles(&job, job.tiles * (job.tiles + 1) / 2);
+}
+
+/*
+ * Layout functions move elements of 1, 2, 4, 8 or 16 bytes. Their
+ * kernels are stamped out once per element type, so that each element
+ * is one load and one store of its own width; a memcpy per element
+ * would be slower and invisible to tracegen's instrumented build.
+ */
+typedef struct { unsigned long long int lo, hi; } elem16;
+
+/*
+ * rows_conflict - Whether t rows stride bytes apart, from a
+ *     block-aligned start, put more than CACHE_E blocks in one set
+ */
+static int rows_conflict(long long int stride, int t)
+{
+	long long int block, other;
+	int r, o, same;
+
+	for (r = 1; r < t; r++) {
+		block = (r * stride) >> CACHE_B;
+		same = 0;
+		for (o = 0; o < r; o++) {
+			other = (o * stride) >> CACHE_B;
+			if (block != other &&
+					((block ^ other) & ((1 << CACHE_S) - 1)) == 0) {
+				same++;
+			}
+		}
+		if (same >= CACHE_E) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * layout_tile - Side of the square tiles of size-byte elements, as
+ *     tile_size picks it for ints: at most a block per tile row, the
+ *     tile's rows of A and B together no more than the cache holds,
+ *     and neither the A rows nor the B rows conflicting in a set
+ */
+static int layout_tile(int M, int N, size_t size)
+{
+	int lines = (1 << CACHE_S) * CACHE_E;
+	int t = (1 << CACHE_B) / (int) size;
+
+	if (2 * t > lines) {
+		t = lines / 2;
+	}
+	for (; t > 1; t /= 2) {
+		if (!rows_conflict((long long int) M * size, t) &&
+				!rows_conflict((long long int) N * size, t)) {
+			return t;
+		}
+	}
+	return 1;
+}
+
+/*
+ * layout_strip - Records per strip of the AoS/SoA conversions, for
+ *     records of fields size-byte fields: a strip of records fills
+ *     half the cache, which leaves the other half for a block of each
+ *     field array as long as there are few fields. A strip longer than
+ *     a block is cut to whole blocks of a field array. Returns 0 if a
+ *     strip would not span a block of a field array: each block of the
+ *     arrays is then loaded once per strip, and the conversions tile
+ *     instead (4-byte 61x67 SoA to AoS: 4706 misses in strips of one
+ *     record, 2115 tiled).
+ */
+static int layout_strip(int fields, size_t size)
+{
+	int cache = ((1 << CACHE_S) * CACHE_E) << CACHE_B;
+	int perblock = (1 << CACHE_B) / (int) size;
+	int r = cache / 2 / (fields * (int) size);
+
+	if (r < perblock) {
+		return 0;
+	}
+	return r - r % perblock;
+}
+
+/*
+ * LAYOUT_KERNELS - The kernels for elements of type T, suffixed sfx:
+ *   naive   B = A^T scanning A row by row
+ *   tiled   B = A^T in t x t tiles
+ *   scatter AoS to SoA: A is N records of M fields, and each strip of
+ *           r records feeds a run of r to each of the M field arrays
+ *   gather  SoA to AoS: A is N field arrays of M, and each strip of r
+ *           records of B is filled from a run of r of each array
+ *   morton  the Z-order tiles of the tile grid square at (ti, tj) of
+ *           side tiles, appended to B at *pos
+ */
+#define LAYOUT_KERNELS(T, sfx) \
+static void naive_##sfx(int M, int N, const T *A, T *B) \
+{ \
+	long long int i, j; \
+\
+	for (i = 0; i < N; i++) { \
+		for (j = 0; j < M; j++) { \
+			B[j * N + i] = A[i * M + j]; \
+		} \
+	} \
+} \
+\
+static void tiled_##sfx(int M, int N, const T *A, T *B, int t) \
+{ \
+	long long int i, j, k, l; \
+\
+	for (i = 0; i < N; i += t) { \
+		for (j = 0; j < M; j += t) { \
+			for (k = i; k < i + t && k < N; k++) { \
+				for (l = j; l < j + t && l < M; l++) { \
+					B[l * N + k] = A[k * M + l]; \
+				} \
+			} \
+		} \
+	} \
+} \
+\
+static void scatter_##sfx(int M, int N, const T *A, T *B, int r) \
+{ \
+	long long int i, j, k; \
+\
+	for (i = 0; i < N; i += r) { \
+		for (j = 0; j < M; j++) { \
+			for (k = i; k < i + r && k < N; k++) { \
+				B[j * N + k] = A[k * M + j]; \
+			} \
+		} \
+	} \
+} \
+\
+static void gather_##sfx(int M, int N, const T *A, T *B, int r) \
+{ \
+	long long int i, j, k; \
+\
+	for (j = 0; j < M; j += r) { \
+		for (i = 0; i < N; i++) { \
+			for (k = j; k < j + r && k < M; k++) { \
+				B[k * N + i] = A[i * M + k]; \
+			} \
+		} \
+	} \
+} \
+\
+static void morton_##sfx(int M, int N, const T *A, T *B, \
+		long long int *pos, int t, int ti, int tj, int side) \
+{ \
+	long long int r, c; \
+	int h = side / 2; \
+\
+	if ((long long int) ti * t >= N || (long long int) tj * t >= M) { \
+		return; \
+	} \
+	if (side == 1) { \
+		for (r = (long long int) ti * t; r < (ti + 1LL) * t && r < N; r++) { \
+			for (c = (long long int) tj * t; c < (tj + 1LL) * t && c < M; c++) { \
+				B[(*pos)++] = A[r * M + c]; \
+			} \
+		} \
+		return; \
+	} \
+	morton_##sfx(M, N, A, B, pos, t, ti, tj, h); \
+	morton_##sfx(M, N, A, B, pos, t, ti, tj + h, h); \
+	morton_##sfx(M, N, A, B, pos, t, ti + h, tj, h); \
+	morton_##sfx(M, N, A, B, pos, t, ti + h, tj + h, h); \
+}
+
+LAYOUT_KERNELS(unsigned char, 8)
+LAYOUT_KERNELS(unsigned short, 16)
+LAYOUT_KERNELS(unsigned int, 32)
+LAYOUT_KERNELS(unsigned long long int, 64)
+LAYOUT_KERNELS(elem16, 128)
+
+/* BY_SIZE - Call the kernel for size-byte elements with args */
+#define BY_SIZE(size, kernel, args) \
+	switch (size) { \
+	case 1: kernel##_8 args; break; \
+	case 2: kernel##_16 args; break; \
+	case 4: kernel##_32 args; break; \
+	case 8: kernel##_64 args; break; \
+	case 16: kernel##_128 args; break; \
+	}
+
+/*
+ * layout_naive - Row-wise scan transpose of any element size, the
+ *     baseline of the layout functions
+ */
+char layout_naive_desc[] = "Row-wise scan transpose, any element size";
+void layout_naive(int M, int N, size_t size, const void *A, void *B)
+{
+	BY_SIZE(size, naive, (M, N, A, B))
+}
+
+/*
+ * layout_tiled - Tiled transpose of any element size, with one block
+ *     per tile row
+ */
+char layout_tiled_desc[] = "Tiled transpose, any element size";
+void layout_tiled(int M, int N, size_t size, const void *A, void *B)
+{
+	BY_SIZE(size, tiled, (M, N, A, B, layout_tile(M, N, size)))
+}
+
+/*
+ * layout_aos_to_soa - Array of N records of M fields to M field
+ *     arrays, a strip of records at a time; records of too many fields
+ *     for a strip are tiled
+ */
+char layout_aos_to_soa_desc[] = "AoS to SoA in strips of records, tiled if too wide";
+void layout_aos_to_soa(int M, int N, size_t size, const void *A, void *B)
+{
+	int r = layout_strip(M, size);
+
+	if (r == 0) {
+		BY_SIZE(size, tiled, (M, N, A, B, layout_tile(M, N, size)))
+	}
+	else {
+		BY_SIZE(size, scatter, (M, N, A, B, r))
+	}
+}
+
+/*
+ * layout_soa_to_aos - N field arrays of M to an array of M records of
+ *     N fields, a strip of records at a time; records of too many
+ *     fields for a strip are tiled
+ */
+char layout_soa_to_aos_desc[] = "SoA to AoS in strips of records, tiled if too wide";
+void layout_soa_to_aos(int M, int N, size_t size, const void *A, void *B)
+{
+	int r = layout_strip(N, size);
+
+	if (r == 0) {
+		BY_SIZE(size, tiled, (M, N, A, B, layout_tile(M, N, size)))
+	}
+	else {
+		BY_SIZE(size, gather, (M, N, A, B, r))
+	}
+}
+
+/*
+ * layout_morton - Row-major to MORTON_TILE(size) square tiles in
+ *     Z-order, found by recursing into the quadrants of the smallest
+ *     power-of-2 square of tiles that covers the matrix
+ */
+char layout_morton_desc[] = "Row-major to Z-order tiles";
+void layout_morton(int M, int N, size_t size, const void *A, void *B)
+{
+	int t = MORTON_TILE(size);
+	int side = 1;
+	long long int pos = 0;
+
+	while ((long long int) side * t < M || (long long int) side * t < N) {
+		side *= 2;
+	}
+	BY_SIZE(size, morton, (M, N, A, B, &pos, t, 0, 0, side))
+}
+
+/*
+ * layout_sse - trans_sse for 4-byte elements, registered for that
+ *     size only
+ */
+char layout_sse_desc[] = "SSE 4x4 transpose of 4-byte elements";
+void layout_sse(int M, int N, size_t size, const void *A, void *B)
+{
+	trans_sse(M, N, (int (*)[M]) A, (int (*)[N]) B);
+}
+
 /*
  * registerFunctions - This function registers your transpose
  *     functions with the driver.  At runtime, the driver will
@@ -147,6 +888,19 @@ void registerFunctions()
 
     /* Register any additional transpose functions */
     registerTransFunction(trans, trans_desc); 
+    registerTransFunction(trans_tiled, trans_tiled_desc);
+    registerTransFunction(trans_recursive, trans_recursive_desc);
+    registerTransFunction(trans_sse, trans_sse_desc);
+    registerTransFunction(trans_avx2, trans_avx2_desc);
+    registerTransFunction(trans_parallel, trans_parallel_desc);
+
+    /* Register the layout functions, with the element sizes they take */
+    registerLayoutFunction(layout_naive, layout_naive_desc, LAYOUT_TRANSPOSE, 0);
+    registerLayoutFunction(layout_tiled, layout_tiled_desc, LAYOUT_TRANSPOSE, 0);
+    registerLayoutFunction(layout_aos_to_soa, layout_aos_to_soa_desc, LAYOUT_TRANSPOSE, 0);
+    registerLayoutFunction(layout_soa_to_aos, layout_soa_to_aos_desc, LAYOUT_TRANSPOSE, 0);
+    registerLayoutFunction(layout_morton, layout_morton_desc, LAYOUT_MORTON, 0);
+    registerLayoutFunction(layout_sse, layout_sse_desc, LAYOUT_TRANSPOSE, 4);
 
 }
 
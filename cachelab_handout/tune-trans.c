@@ -0,0 +1,373 @@
+/*
+ * tune-trans.c - Searches tiled transpose variants for one matrix shape
+ *     and cache, and writes the best one out as a C transpose function.
+ *
+ * Every candidate is a tile size (rows x columns of A), the order in
+ * which tiles are visited, the order inside a tile (along rows of A or
+ * rows of B) and a buffering strategy:
+ *   direct    B[l][k] = A[k][l] element by element
+ *   diagonal  as direct, but the diagonal element of a row is copied
+ *             last, so A and B blocks sharing a set do not thrash
+ *   buffer    a tile row is read into local variables before any of it
+ *             is written (at most 8 of them, the lab allows 12 locals)
+ * Candidates are evaluated by replaying their accesses through the
+ * in-process cache model, with A and B laid out as in tracegen, so the
+ * search takes seconds instead of a valgrind run per candidate.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "cachemodel.h"
+
+/* tracegen's matrices: static int A[256][256], B[256][256], back to back */
+#define MAXN 256
+#define A_BASE 0x0ULL
+#define B_BASE (A_BASE + sizeof(int) * MAXN * MAXN)
+
+/* Largest tile side searched, and the most locals a buffer may use */
+#define MAX_TILE 32
+#define MAX_BUFFER 8
+
+/* How many of the best candidates to list */
+#define SHOW_BEST 5
+
+#define ORDER_ROWS 0	/* tiles row by row */
+#define ORDER_COLS 1	/* tiles column by column */
+
+#define INNER_A 0	/* inside a tile, walk the rows of A */
+#define INNER_B 1	/* inside a tile, walk the rows of B */
+
+#define BUF_DIRECT   0
+#define BUF_DIAGONAL 1
+#define BUF_ROW      2
+
+static const char* order_names[] = { "row-major tiles", "column-major tiles" };
+static const char* inner_names[] = { "along A rows", "along B rows" };
+static const char* buffer_names[] = { "direct", "diagonal last", "row buffer" };
+
+/* candidate - one point of the search space and its miss count */
+typedef struct _candidate {
+	int th;		/* tile rows of A */
+	int tw;		/* tile columns of A */
+	int order;
+	int inner;
+	int buffer;
+	unsigned int misses;
+} candidate;
+
+/* Globals set on the command line */
+static int M = 0;
+static int N = 0;
+static cache_model* model;
+
+/* Misses above this abandon the candidate being evaluated */
+static unsigned int cutoff;
+
+static int read_a(int k, int l)
+{
+	return model_access(model, A_BASE + sizeof(int) * ((unsigned long long int) k * M + l));
+}
+
+static int write_b(int l, int k)
+{
+	return model_access(model, B_BASE + sizeof(int) * ((unsigned long long int) l * N + k));
+}
+
+/*
+ * run_tile - Replay the accesses of one tile, in exactly the order of
+ *     the code emit_kernel generates for the candidate
+ */
+static void run_tile(const candidate* c, int i, int j)
+{
+	int k, l, d, x;
+	int iend = i + c->th < N ? i + c->th : N;
+	int jend = j + c->tw < M ? j + c->tw : M;
+
+	if (c->inner == INNER_A) {
+		for (k = i; k < iend; k++) {
+			if (c->buffer == BUF_ROW && j + c->tw <= M) {
+				for (x = 0; x < c->tw; x++) read_a(k, j + x);
+				for (x = 0; x < c->tw; x++) write_b(j + x, k);
+				continue;
+			}
+			d = -1;
+			for (l = j; l < jend; l++) {
+				if (c->buffer == BUF_DIAGONAL && l == k) {
+					d = l;
+					continue;
+				}
+				read_a(k, l);
+				write_b(l, k);
+			}
+			if (d != -1) {
+				read_a(k, d);
+				write_b(d, k);
+			}
+		}
+	}
+	else {
+		for (l = j; l < jend; l++) {
+			if (c->buffer == BUF_ROW && i + c->th <= N) {
+				for (x = 0; x < c->th; x++) read_a(i + x, l);
+				for (x = 0; x < c->th; x++) write_b(l, i + x);
+				continue;
+			}
+			d = -1;
+			for (k = i; k < iend; k++) {
+				if (c->buffer == BUF_DIAGONAL && l == k) {
+					d = k;
+					continue;
+				}
+				read_a(k, l);
+				write_b(l, k);
+			}
+			if (d != -1) {
+				read_a(d, l);
+				write_b(l, d);
+			}
+		}
+	}
+}
+
+/*
+ * evaluate - Count the misses of candidate c, giving up as soon as it
+ *     cannot beat the cutoff
+ */
+static void evaluate(candidate* c)
+{
+	int i, j;
+
+	reset_cache_model(model);
+	if (c->order == ORDER_ROWS) {
+		for (i = 0; i < N && model->misses <= cutoff; i += c->th)
+			for (j = 0; j < M; j += c->tw)
+				run_tile(c, i, j);
+	}
+	else {
+		for (j = 0; j < M && model->misses <= cutoff; j += c->tw)
+			for (i = 0; i < N; i += c->th)
+				run_tile(c, i, j);
+	}
+	c->misses = model->misses;
+}
+
+/*
+ * emit_kernel - Write the C transpose function for candidate c
+ */
+static void emit_kernel(FILE* out, const candidate* c, int s, int E, int b)
+{
+	int outer_row = (c->inner == INNER_A);
+	int width = outer_row ? c->tw : c->th;
+	int x;
+
+	fprintf(out, "/*\n * trans_tuned - Generated by tune-trans for M=%d N=%d s=%d E=%d b=%d:\n", M, N, s, E, b);
+	fprintf(out, " *     %dx%d tiles, %s, %s, %s; %u misses in the model\n */\n",
+			c->th, c->tw, order_names[c->order], inner_names[c->inner],
+			buffer_names[c->buffer], c->misses);
+	fprintf(out, "char trans_tuned_desc[] = \"Tuned %dx%d tiles, %s, %s, %s\";\n",
+			c->th, c->tw, order_names[c->order], inner_names[c->inner], buffer_names[c->buffer]);
+	fprintf(out, "void trans_tuned(int M, int N, int A[N][M], int B[M][N])\n{\n");
+	fprintf(out, "\tint i, j, k, l");
+	if (c->buffer == BUF_DIAGONAL) {
+		fprintf(out, ", d");
+	}
+	if (c->buffer == BUF_ROW) {
+		for (x = 0; x < width; x++) fprintf(out, ", b%d", x);
+	}
+	fprintf(out, ";\n\n");
+
+	if (c->order == ORDER_ROWS) {
+		fprintf(out, "\tfor (i = 0; i < N; i += %d) {\n", c->th);
+		fprintf(out, "\t\tfor (j = 0; j < M; j += %d) {\n", c->tw);
+	}
+	else {
+		fprintf(out, "\tfor (j = 0; j < M; j += %d) {\n", c->tw);
+		fprintf(out, "\t\tfor (i = 0; i < N; i += %d) {\n", c->th);
+	}
+
+	/* the outer loop of a tile walks k (rows of A) or l (rows of B) */
+	if (outer_row) {
+		fprintf(out, "\t\t\tfor (k = i; k < i + %d && k < N; k++) {\n", c->th);
+	}
+	else {
+		fprintf(out, "\t\t\tfor (l = j; l < j + %d && l < M; l++) {\n", c->tw);
+	}
+
+	if (c->buffer == BUF_ROW) {
+		if (outer_row) {
+			fprintf(out, "\t\t\t\tif (j + %d <= M) {\n", width);
+			for (x = 0; x < width; x++)
+				fprintf(out, "\t\t\t\t\tb%d = A[k][j+%d];\n", x, x);
+			for (x = 0; x < width; x++)
+				fprintf(out, "\t\t\t\t\tB[j+%d][k] = b%d;\n", x, x);
+		}
+		else {
+			fprintf(out, "\t\t\t\tif (i + %d <= N) {\n", width);
+			for (x = 0; x < width; x++)
+				fprintf(out, "\t\t\t\t\tb%d = A[i+%d][l];\n", x, x);
+			for (x = 0; x < width; x++)
+				fprintf(out, "\t\t\t\t\tB[l][i+%d] = b%d;\n", x, x);
+		}
+		fprintf(out, "\t\t\t\t\tcontinue;\n\t\t\t\t}\n");
+	}
+	if (c->buffer == BUF_DIAGONAL) {
+		fprintf(out, "\t\t\t\td = -1;\n");
+	}
+
+	if (outer_row) {
+		fprintf(out, "\t\t\t\tfor (l = j; l < j + %d && l < M; l++) {\n", c->tw);
+	}
+	else {
+		fprintf(out, "\t\t\t\tfor (k = i; k < i + %d && k < N; k++) {\n", c->th);
+	}
+	if (c->buffer == BUF_DIAGONAL) {
+		fprintf(out, "\t\t\t\t\tif (l == k) {\n\t\t\t\t\t\td = %s;\n\t\t\t\t\t\tcontinue;\n\t\t\t\t\t}\n",
+				outer_row ? "l" : "k");
+	}
+	fprintf(out, "\t\t\t\t\tB[l][k] = A[k][l];\n\t\t\t\t}\n");
+	if (c->buffer == BUF_DIAGONAL) {
+		if (outer_row) {
+			fprintf(out, "\t\t\t\tif (d != -1) {\n\t\t\t\t\tB[d][k] = A[k][d];\n\t\t\t\t}\n");
+		}
+		else {
+			fprintf(out, "\t\t\t\tif (d != -1) {\n\t\t\t\t\tB[l][d] = A[d][l];\n\t\t\t\t}\n");
+		}
+	}
+	fprintf(out, "\t\t\t}\n\t\t}\n\t}\n}\n");
+}
+
+static int by_misses(const void* a, const void* b)
+{
+	const candidate* x = (const candidate*) a;
+	const candidate* y = (const candidate*) b;
+
+	return (x->misses > y->misses) - (x->misses < y->misses);
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char* argv[])
+{
+	printf("Usage: %s [-h] -M <cols> -N <rows> [-s <num> -E <num> -b <num>] [-p <policy>] [-o <file>]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h          Print this help message.\n");
+	printf("  -M <cols>   Number of matrix columns (max %d).\n", MAXN);
+	printf("  -N <rows>   Number of matrix rows (max %d).\n", MAXN);
+	printf("  -s <num>    Number of set index bits (default 5).\n");
+	printf("  -E <num>    Number of lines per set (default 1).\n");
+	printf("  -b <num>    Number of block offset bits (default 5).\n");
+	printf("  -p <policy> Replacement policy (default lru): %s\n", policy_names());
+	printf("  -o <file>   Write the generated transpose function to <file>.\n");
+	printf("Example: %s -M 61 -N 67 -o trans_tuned.c\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+	int opt, i, n = 0, th, tw, order, inner, buffer;
+	int s = 5, E = 1, b = 5;
+	const policy* pol = find_policy("lru");
+	char* outfilename = NULL;
+	candidate* cands;
+	FILE* out;
+
+	while ((opt = getopt(argc, argv, "M:N:s:E:b:p:o:h")) != -1) {
+		switch (opt) {
+			case 'M': M = atoi(optarg);
+					  break;
+			case 'N': N = atoi(optarg);
+					  break;
+			case 's': s = atoi(optarg);
+					  break;
+			case 'E': E = atoi(optarg);
+					  break;
+			case 'b': b = atoi(optarg);
+					  break;
+			case 'p': pol = find_policy(optarg);
+					  if (pol == NULL) {
+						  printf("Unknown policy: %s\n", optarg);
+						  usage(argv);
+						  exit(1);
+					  }
+					  break;
+			case 'o': outfilename = optarg;
+					  break;
+			case 'h': usage(argv);
+					  exit(0);
+			default: usage(argv);
+					 exit(1);
+		}
+	}
+	if (M <= 0 || N <= 0 || M > MAXN || N > MAXN) {
+		printf("Error: -M and -N are required and at most %d\n", MAXN);
+		usage(argv);
+		exit(1);
+	}
+	if (s < 0 || b < 0 || E < 1 || !policy_supports(pol, E)) {
+		printf("Error: bad cache geometry or policy %s cannot manage E=%d\n", pol->name, E);
+		exit(1);
+	}
+
+	model = new_cache_model(s, E, b, pol);
+	cands = (candidate*) malloc(sizeof(candidate) * (SHOW_BEST + 1));
+	cutoff = (unsigned int) -1;
+	for (th = 1; th <= MAX_TILE; th++) {
+		for (tw = 1; tw <= MAX_TILE; tw++) {
+			for (order = ORDER_ROWS; order <= ORDER_COLS; order++) {
+				for (inner = INNER_A; inner <= INNER_B; inner++) {
+					for (buffer = BUF_DIRECT; buffer <= BUF_ROW; buffer++) {
+						candidate* c = &cands[n];
+
+						if (buffer == BUF_ROW && (inner == INNER_A ? tw : th) > MAX_BUFFER) {
+							continue;
+						}
+						c->th = th;
+						c->tw = tw;
+						c->order = order;
+						c->inner = inner;
+						c->buffer = buffer;
+						evaluate(c);
+						n++;
+						/* keep the best SHOW_BEST; the rest only has to
+						   be followed until it falls behind them */
+						if (n > SHOW_BEST) {
+							qsort(cands, n, sizeof(candidate), by_misses);
+							n = SHOW_BEST;
+							cutoff = cands[n - 1].misses;
+						}
+					}
+				}
+			}
+		}
+	}
+	qsort(cands, n, sizeof(candidate), by_misses);
+
+	printf("Best of the tiled transposes for M=%d N=%d on s=%d E=%d b=%d (%s):\n",
+			M, N, s, E, b, pol->name);
+	for (i = 0; i < n; i++) {
+		printf("  %2dx%-2d tiles, %-18s %-12s %-13s misses:%u\n",
+				cands[i].th, cands[i].tw, order_names[cands[i].order],
+				inner_names[cands[i].inner], buffer_names[cands[i].buffer],
+				cands[i].misses);
+	}
+
+	if (outfilename != NULL) {
+		out = fopen(outfilename, "w");
+		if (out == NULL) {
+			perror(outfilename);
+			exit(1);
+		}
+		emit_kernel(out, &cands[0], s, E, b);
+		fclose(out);
+		printf("Wrote trans_tuned() to %s\n", outfilename);
+	}
+	else {
+		printf("\n");
+		emit_kernel(stdout, &cands[0], s, E, b);
+	}
+
+	free(cands);
+	free_cache_model(model);
+	return 0;
+}
@@ -29,7 +29,7 @@ static unsigned long n_calloc  = 0;
 static unsigned long n_realloc = 0;
 static unsigned long n_allocb  = 0;
 static unsigned long n_freeb   = 0;
-static item *list = NULL;
+static memlist *list = NULL;
 
 //
 // init - this function is called once when the shared library is loaded
@@ -29,7 +29,7 @@ static unsigned long n_calloc  = 0;
 static unsigned long n_realloc = 0;
 static unsigned long n_allocb  = 0;
 static unsigned long n_freeb   = 0;
-static item *list = NULL;
+static memlist *list = NULL;
 
 //
 // init - this function is called once when the shared library is loaded
@@ -48,6 +48,16 @@ void init(void)
   // ...
 }
 
+//
+// log_block - log a block that has not been freed
+//
+static void log_block(item *i, void *arg)
+{
+  if (i->cnt > 0) {
+    LOG_BLOCK(i->ptr, i->size, i->cnt);
+  }
+}
+
 //
 // fini - this function is called once when the shared library is unloaded
 //
@@ -61,14 +71,7 @@ void fini(void)
   if (n_allocb != n_freeb) {
     LOG_NONFREED_START();
 
-    item *prev = list, *cur = prev->next;
-    while(cur != NULL) {
-      if (cur->cnt > 0) {
-        LOG_BLOCK(cur->ptr, cur->size, cur->cnt);
-      }
-      prev = cur;
-      cur = cur->next;
-    }
+    walk_list(list, log_block, NULL);
   }
 
   LOG_STOP();
@@ -2,16 +2,78 @@
 //
 // memtrace
 //
-// trace calls to the dynamic memory manager
+// trace calls to the dynamic memory manager: malloc, calloc, realloc,
+// reallocarray and free, the aligned allocation functions (whose
+// blocks free releases), and C++'s operator new and delete
+//
+// The tracer never allocates its metadata with malloc: its tables come
+// from mmap, and what libc allocates on its behalf comes from a static
+// bootstrap arena (memarena.h), so it needs no libc function to start.
+// Once the arena is used up, libc serves the tracer too; those blocks
+// are recorded apart, so freeing them is neither traced nor illegal.
+//
+// With MEMTRACE_SAMPLE=<bytes>, only a sample of the calls is traced:
+// every allocated byte is a sampling point with probability 1/bytes,
+// and a block is traced when it holds one, so a block of size s is
+// traced with probability p = 1 - exp(-s/bytes). Counting each sampled
+// block as 1/p blocks of s/p bytes gives unbiased estimates of the
+// allocated and live heap. Calls that are not sampled only update a
+// few per-thread counters; double and illegal frees are detected for
+// sampled blocks only, and the event log holds sampled calls only.
+//
+// With MEMTRACE_STACKS=<depth>, the call stack of every traced block
+// is captured, up to depth frames, and the blocks that have not been
+// freed are also reported per call stack. MEMTRACE_FLAME=<file> writes
+// that report in the collapsed format of flamegraph.pl, weighted by
+// live bytes (capturing 32 frames unless MEMTRACE_STACKS says else).
+//
+// fini also prints histograms of the allocation sizes, of the lifetimes
+// of the blocks, in calls and in ns, and of the growth ratios of
+// realloc; MEMTRACE_JSON=<file> writes them as JSON. A block keeps its
+// birth through realloc. In sampling mode, all but the sizes are
+// estimated from the sampled blocks; a block that is sampled only when
+// it is realloc'd is born then.
+//
+// With MEMTRACE_SOCKET=<path>, a background thread listens on a Unix
+// domain socket at path and answers each connection with a JSON
+// snapshot of the running program: the statistics and histograms so
+// far, the blocks that have not been freed and, with stacks, the live
+// bytes per call stack (tools/memsnap fetches it). The snapshot copies
+// the block table a shard at a time without locking (walk_snapshot),
+// so the program's threads are not stopped while it is taken.
+//
+// With MEMTRACE_SNAPSHOT=<prefix>, heap snapshots (memheap.h) are
+// written to <prefix>.<pid>.<n>.heap: the live blocks and bytes by call
+// stack and size class, and when they were taken. A snapshot is taken
+// whenever the program gets MEMTRACE_SNAPSHOT_SIGNAL (a number, by
+// default SIGUSR2; 0 for none), every MEMTRACE_SNAPSHOT_INTERVAL
+// seconds if that is set, and at fini. tools/memdiff reports the growth
+// between two snapshots, which points at the call sites that leak; the
+// snapshots capture 32 frames unless MEMTRACE_STACKS says else.
 //
 #define _GNU_SOURCE
 
 #include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/mman.h>
 #include <memlog.h>
 #include <memlist.h>
+#include <memstack.h>
+#include <memhist.h>
+#include <memarena.h>
+#include <memserve.h>
+#include <memheap.h>
 
 //
 // function pointers to stdlib's memory management functions
@@ -20,16 +82,357 @@ static void *(*mallocp)(size_t size) = NULL;
 static void (*freep)(void *ptr) = NULL;
 static void *(*callocp)(size_t nmemb, size_t size);
 static void *(*reallocp)(void *ptr, size_t size);
+static int (*posix_memalignp)(void **res, size_t align, size_t size);
+static void *(*aligned_allocp)(size_t align, size_t size);
+static void *(*memalignp)(size_t align, size_t size);
+static void *(*vallocp)(size_t size);
+static void *(*pvallocp)(size_t size);
+
+//
+// statistics, kept per thread and added up at fini
+//
+typedef struct __counters {
+  unsigned long n_malloc;
+  unsigned long n_calloc;
+  unsigned long n_realloc;
+  unsigned long n_allocb;
+  unsigned long n_freeb;
+  unsigned long n_samples;      // sampling mode: blocks sampled
+  double est_allocb;            //   estimated bytes allocated
+  double est_freeb;             //   estimated bytes freed
+  long long until;              //   bytes left until the next sample
+  uint64_t rng;                 //   random generator state
+  hist sizes;                   // allocation sizes
+  hist life_ops;                // lifetimes of the blocks, in calls
+  hist life_ns;                 //   and in ns
+  hist growth;                  // new / old size of realloc, in 1/GROWTH_SCALE
+  struct __counters *next;      // all threads' counters, newest first
+} counters;
+
+#define GROWTH_SCALE 256
+
+static counters *all_counters = NULL;
+static memlist *list = NULL;
+
+//
+// the blocks libc gave the tracer once the arena was used up, which the
+// program may free (a stdio buffer, a thread's TLS, ...): the wrappers
+// hand them back to libc untraced. own_blocks counts them, so that
+// while there are none a free need not look them up.
+//
+static memlist *own_list = NULL;
+static long own_blocks = 0;
+
+//
+// number of calls so far, the clock of the lifetimes in calls
+//
+static uint64_t ops = 0;
+
+//
+// mean number of bytes between two samples; 0 traces every call
+//
+static double sample_mean = 0;
+static struct timespec started;
+
+//
+// frames of call stack captured per block (0: none), and the file the
+// collapsed stacks go to, if any
+//
+static int stack_depth = 0;
+static const char *flame_file = NULL;
+
+//
+// file the statistics go to as JSON, if any
+//
+static const char *json_file = NULL;
+
+//
+// path of the control socket, if any
+//
+static const char *socket_path = NULL;
+
+//
+// prefix of the heap snapshot files, if any, and what triggers them
+//
+static const char *snapshot_prefix = NULL;
+static int snapshot_signal = SIGUSR2;
+static double snapshot_interval = 0;
+
+//
+// per-thread state lives in the static TLS block (initial-exec), whose
+// use never allocates
+//
+//   my_counters  the thread's statistics
+//   in_tracer    set while the thread runs one of the wrappers, so that
+//                allocations made on its behalf (by dlsym, stdio or
+//                pthread_create) are served by the bootstrap arena,
+//                untraced
+//
+static __thread counters *my_counters __attribute__((tls_model("initial-exec"))) = NULL;
+static __thread int in_tracer __attribute__((tls_model("initial-exec"))) = 0;
+
+//
+// uniform - draw a number uniformly distributed in (0, 1] from the
+// thread's generator (xorshift64*)
+//
+static double uniform(counters *c)
+{
+  uint64_t x;
+
+  c->rng ^= c->rng >> 12;
+  c->rng ^= c->rng << 25;
+  c->rng ^= c->rng >> 27;
+  x = c->rng * 0x2545f4914f6cdd1dULL;
+
+  return ((x >> 11) + 1) * 0x1.0p-53;
+}
+
+//
+// next_gap - draw the number of bytes until the thread's next sample,
+// exponentially distributed with mean sample_mean
+//
+static long long next_gap(counters *c)
+{
+  // the +1 keeps every gap at least 1 byte
+  return (long long)(-sample_mean * log(uniform(c))) + 1;
+}
+
+//
+// round_random - round x up with probability its fraction, down
+// otherwise, so that the rounded values add up to x on average
+//
+static unsigned long round_random(counters *c, double x)
+{
+  double n = floor(x);
+
+  return (unsigned long)n + (uniform(c) <= x - n);
+}
+
+//
+// stats - the calling thread's counters, created on first use
+//
+static counters *stats(void)
+{
+  counters *c = my_counters;
+  struct timespec now;
+
+  if (c == NULL) {
+    c = mmap(NULL, sizeof(counters), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (c == MAP_FAILED) {
+      mlog("Error mapping thread statistics");
+      exit(1);
+    }
+    c->next = __atomic_load_n(&all_counters, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&all_counters, &c->next, c, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    my_counters = c;
+
+    if (sample_mean > 0) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      c->rng = ((uintptr_t)c ^ (uint64_t)now.tv_nsec) | 1;
+      c->until = next_gap(c);
+    }
+  }
+
+  return c;
+}
+
+//
+// weight - the number of blocks of size bytes a sampled one stands for
+//
+static double weight(size_t size)
+{
+  return -1 / expm1(-(double)size / sample_mean);
+}
+
+//
+// sampled - whether the thread's next block, of size bytes, is sampled
+//
+static int sampled(counters *c, size_t size)
+{
+  if ((c->until -= (long long)size) > 0) return 0;
+
+  // the gaps are exponential, so the overshoot need not carry over
+  c->until = next_gap(c);
+  c->n_samples++;
+  c->est_allocb += weight(size) * size;
+  return 1;
+}
+
+//
+// traced - whether a new block of size bytes is traced
+//
+static int traced(counters *c, size_t size)
+{
+  return (sample_mean == 0) || ((size > 0) && sampled(c, size));
+}
+
+//
+// call_stack - capture the call stack of a new block of size bytes, fp
+// being the frame of the wrapper; returns its id
+//
+static unsigned int call_stack(void *fp, size_t size)
+{
+  void *frames[STACK_MAX_DEPTH];
+  unsigned int id;
+  double w;
+
+  if (stack_depth == 0) return 0;
+
+  id = stack_intern(frames, stack_capture(frames, stack_depth, fp));
+  if (sample_mean > 0) {
+    // the counters of a stack are integers, so the weight is rounded
+    // at random rather than to the nearest
+    w = weight(size);
+    stack_account(id, round_random(stats(), w), round_random(stats(), w * size));
+  }
+  else {
+    stack_account(id, 1, size);
+  }
+
+  return id;
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//
+// track - add a new block to the list, fp being the frame of the
+// wrapper; a block realloc'd from born keeps its birth
+//
+static void track(void *ptr, size_t size, void *fp, const item *born)
+{
+  item it = { ptr, size };
+
+  if (born != NULL) {
+    it.op = born->op;
+    it.ns = born->ns;
+  }
+  else {
+    it.op = __atomic_load_n(&ops, __ATOMIC_RELAXED);
+    it.ns = now_ns();
+  }
+  it.stack = call_stack(fp, size);
+
+  alloc_item(list, &it);
+}
+
+//
+// retire - add the lifetime of a block being freed to the histograms
+//
+static void retire(counters *c, const item *it)
+{
+  double w = (sample_mean > 0) ? weight(it->size) : 1;
+
+  hist_add(&c->life_ops, __atomic_load_n(&ops, __ATOMIC_RELAXED) - it->op, w);
+  hist_add(&c->life_ns, now_ns() - it->ns, w);
+}
+
+//
+// grow - add the growth ratio of a block realloc'd from old
+//
+static void grow(counters *c, const item *old, size_t new_size)
+{
+  double w = (sample_mean > 0) ? weight(old->size) : 1;
+
+  if (old->size > 0) hist_add(&c->growth, (uint64_t)new_size * GROWTH_SCALE / old->size, w);
+}
+
+//
+// untrace - forget a sampled block being freed; returns its item, or
+// NULL if it was not sampled (or is freed already)
+//
+static item *untrace(void *ptr)
+{
+  item *it = release(list, ptr);
+
+  if ((it == NULL) || (it->cnt == 0)) return NULL;
+  forget(list, ptr);
+  stats()->est_freeb += weight(it->size) * it->size;
+
+  return it;
+}
+
+//
+// sym - look up the next definition of name
+//
+static void *sym(const char *name)
+{
+  void *p;
+  char *err;
+
+  dlerror();
+  p = dlsym(RTLD_NEXT, name);
+  if ((err = dlerror()) != NULL) {
+    mlog(err);
+    exit(1);
+  }
+
+  return p;
+}
 
 //
-// statistics & other global variables
+// resolve - look up libc's functions once; a thread arriving while
+// another one resolves waits for it
 //
-static unsigned long n_malloc  = 0;
-static unsigned long n_calloc  = 0;
-static unsigned long n_realloc = 0;
-static unsigned long n_allocb  = 0;
-static unsigned long n_freeb   = 0;
-static item *list = NULL;
+static void resolve(void)
+{
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static int resolved = 0;
+
+  if (__atomic_load_n(&resolved, __ATOMIC_ACQUIRE)) return;
+
+  pthread_mutex_lock(&lock);
+  if (!resolved) {
+    const char *mean = getenv("MEMTRACE_SAMPLE");
+    const char *depth = getenv("MEMTRACE_STACKS");
+    const char *env;
+
+    if ((mean != NULL) && ((sample_mean = strtod(mean, NULL)) < 0)) sample_mean = 0;
+    if (depth != NULL) stack_depth = atoi(depth);
+    json_file = getenv("MEMTRACE_JSON");
+    flame_file = getenv("MEMTRACE_FLAME");
+    if ((flame_file != NULL) && (*flame_file == '\0')) flame_file = NULL;
+    socket_path = getenv("MEMTRACE_SOCKET");
+    if ((socket_path != NULL) && (*socket_path == '\0')) socket_path = NULL;
+    snapshot_prefix = getenv("MEMTRACE_SNAPSHOT");
+    if ((snapshot_prefix != NULL) && (*snapshot_prefix == '\0')) snapshot_prefix = NULL;
+    if ((env = getenv("MEMTRACE_SNAPSHOT_SIGNAL")) != NULL) snapshot_signal = atoi(env);
+    if ((env = getenv("MEMTRACE_SNAPSHOT_INTERVAL")) != NULL) snapshot_interval = strtod(env, NULL);
+    if (((flame_file != NULL) || (snapshot_prefix != NULL)) && (depth == NULL)) {
+      stack_depth = STACK_MAX_DEPTH;
+    }
+    if (stack_depth < 0) stack_depth = 0;
+    if (stack_depth > STACK_MAX_DEPTH) stack_depth = STACK_MAX_DEPTH;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    mallocp = sym("malloc");
+    freep = sym("free");
+    callocp = sym("calloc");
+    reallocp = sym("realloc");
+    posix_memalignp = sym("posix_memalign");
+    aligned_allocp = sym("aligned_alloc");
+    memalignp = sym("memalign");
+    vallocp = sym("valloc");
+    pvallocp = sym("pvalloc");
+    // the table of all memory (de-)allocations exists before the first
+    // call is traced, which may come before init (not needed for part 1)
+    list = new_list();
+    own_list = new_list();
+    __atomic_store_n(&resolved, 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+static void report(int fd);
+static void take_snapshot(void);
 
 //
 // init - this function is called once when the shared library is loaded
@@ -37,15 +440,425 @@ static item *list = NULL;
 __attribute__((constructor))
 void init(void)
 {
-  char *error;
+  in_tracer = 1;
+  resolve();
 
   LOG_START();
 
-  // initialize a new list to keep track of all memory (de-)allocations
-  // (not needed for part 1)
-  list = new_list();
+  if ((socket_path != NULL) && (serve_start(socket_path, report) < 0)) {
+    mlog("Error listening on '%s': %s", socket_path, strerror(errno));
+  }
+  if ((snapshot_prefix != NULL) &&
+      (serve_trigger(snapshot_signal, snapshot_interval, take_snapshot) < 0)) {
+    mlog("Error starting heap snapshots: %s", strerror(errno));
+  }
+
+  in_tracer = 0;
+}
 
-  // ...
+//
+// log_block - log a block that has not been freed
+//
+static void log_block(item *i, void *arg)
+{
+  if (i->cnt > 0) {
+    LOG_BLOCK(i->ptr, i->size, i->cnt);
+  }
+}
+
+//
+// add_live - add a sampled block that has not been freed to the estimate
+//
+static void add_live(item *i, void *arg)
+{
+  double *live = arg;
+
+  if (i->cnt > 0) {
+    live[0] += weight(i->size) * i->size;
+    live[1] += weight(i->size);
+  }
+}
+
+//
+// live bytes and blocks per call stack, and the order of the stacks
+//
+typedef struct __stack_live {
+  double bytes;
+  double blocks;
+} stack_live;
+
+static void add_stack(item *i, void *arg)
+{
+  stack_live *live = arg;
+  double w = (sample_mean > 0) ? weight(i->size) : 1;
+
+  if (i->cnt > 0) {
+    live[i->stack].bytes += w * i->size;
+    live[i->stack].blocks += w;
+  }
+}
+
+static int by_live_bytes(const void *a, const void *b, void *arg)
+{
+  stack_live *live = arg;
+  double x = live[*(const unsigned int*)a].bytes, y = live[*(const unsigned int*)b].bytes;
+
+  return (x < y) - (x > y);
+}
+
+//
+// new_stack_live - zeroed live counts for n stacks followed by an array
+// of n ids, in bytes of mmap'd memory; NULL on error
+//
+static stack_live *new_stack_live(unsigned int n, unsigned int **ids, size_t *bytes)
+{
+  stack_live *live;
+
+  *bytes = n * (sizeof(stack_live) + sizeof(unsigned int));
+  live = mmap(NULL, *bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (live == MAP_FAILED) return NULL;
+  *ids = (unsigned int*)(live + n);
+
+  return live;
+}
+
+//
+// sort_stacks - order the ids of n stacks by live bytes, most first
+//
+static void sort_stacks(unsigned int *ids, unsigned int n, stack_live *live)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; i++) ids[i] = i;
+  qsort_r(ids, n, sizeof(unsigned int), by_live_bytes, live);
+}
+
+//
+// write_flame - write the stacks with live blocks as collapsed stacks,
+// outermost frame first
+//
+static void write_flame(unsigned int *ids, unsigned int n, stack_live *live)
+{
+  FILE *f = fopen(flame_file, "w");
+  char name[256];
+  unsigned int i;
+  int k;
+
+  if (f == NULL) {
+    mlog("Error opening '%s'", flame_file);
+    return;
+  }
+
+  for (i = 0; (i < n) && (live[ids[i]].blocks > 0); i++) {
+    const stack *s = stack_get(ids[i]);
+
+    if (s->depth == 0) fputs("[unknown]", f);
+    for (k = s->depth - 1; k >= 0; k--) {
+      fprintf(f, "%s%s", stack_symbol(s->frames[k], name, sizeof(name)), k ? ";" : "");
+    }
+    fprintf(f, " %.0f\n", live[ids[i]].bytes);
+  }
+
+  fclose(f);
+}
+
+//
+// log_stacks - log the blocks that have not been freed per call stack,
+// most live bytes first
+//
+static void log_stacks(void)
+{
+  unsigned int i, n = stack_count(), *ids;
+  stack_live *live;
+  char name[256];
+  size_t bytes;
+  int k;
+
+  if ((stack_depth == 0) || (n == 0)) return;
+  if ((live = new_stack_live(n, &ids, &bytes)) == NULL) return;
+
+  walk_list(list, add_stack, live);
+  sort_stacks(ids, n, live);
+
+  if (live[ids[0]].blocks > 0) LOG_STACKS_START();
+  for (i = 0; (i < n) && (live[ids[i]].blocks > 0); i++) {
+    const stack *s = stack_get(ids[i]);
+
+    LOG_STACK(ids[i], live[ids[i]].bytes, live[ids[i]].blocks, s->allocs, s->bytes);
+    for (k = 0; k < (int)s->depth; k++) {
+      LOG_FRAME(s->frames[k], stack_symbol(s->frames[k], name, sizeof(name)));
+    }
+  }
+
+  if (flame_file != NULL) write_flame(ids, n, live);
+
+  munmap(live, bytes);
+}
+
+//
+// log_sampling - log the estimates of sampling mode; returns whether
+// sampled blocks have not been freed
+//
+static int log_sampling(counters *total)
+{
+  struct timespec now;
+  double secs, live[2] = { 0, 0 };
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  secs = (now.tv_sec - started.tv_sec) + (now.tv_nsec - started.tv_nsec) / 1e9;
+  walk_list(list, add_live, live);
+
+  LOG_SAMPLING(sample_mean, total->n_samples, total->n_allocb, total->est_allocb,
+               total->est_freeb, live[0], live[1],
+               secs > 0 ? total->est_allocb / secs : 0);
+
+  return live[1] > 0;
+}
+
+//
+// json_stats - write the statistics and histograms as the members of a
+// JSON object
+//
+static void json_stats(FILE *f, counters *total)
+{
+  fprintf(f, "  \"sample_interval\": %.0f,\n", sample_mean);
+  fprintf(f, "  \"calls\": { \"malloc\": %lu, \"calloc\": %lu, \"realloc\": %lu },\n",
+          total->n_malloc, total->n_calloc, total->n_realloc);
+  fprintf(f, "  \"allocated_total\": %lu,\n", total->n_allocb);
+  fprintf(f, "  \"sizes\": ");
+  hist_json(f, &total->sizes, 1);
+  fprintf(f, ",\n  \"lifetime_ops\": ");
+  hist_json(f, &total->life_ops, 1);
+  fprintf(f, ",\n  \"lifetime_ns\": ");
+  hist_json(f, &total->life_ns, 1);
+  fprintf(f, ",\n  \"realloc_growth\": ");
+  hist_json(f, &total->growth, GROWTH_SCALE);
+}
+
+//
+// write_json - write the statistics and histograms as JSON
+//
+static void write_json(counters *total)
+{
+  FILE *f = fopen(json_file, "w");
+
+  if (f == NULL) {
+    mlog("Error opening '%s'", json_file);
+    return;
+  }
+
+  fprintf(f, "{\n");
+  json_stats(f, total);
+  fprintf(f, "\n}\n");
+
+  fclose(f);
+}
+
+//
+// log_histograms - log the histograms, and write them as JSON
+//
+static void log_histograms(counters *total)
+{
+  hist_log("Allocation sizes (bytes)", &total->sizes, 1);
+  hist_log("Lifetimes (calls)", &total->life_ops, 1);
+  hist_log("Lifetimes (ns)", &total->life_ns, 1);
+  hist_log("Realloc growth (new/old size)", &total->growth, GROWTH_SCALE);
+
+  if (json_file != NULL) write_json(total);
+}
+
+//
+// sum_counters - add up the counters of all threads; those of threads
+// still running change meanwhile, so the sums may miss calls in flight
+//
+static void sum_counters(counters *total)
+{
+  counters *c;
+
+  for (c = __atomic_load_n(&all_counters, __ATOMIC_ACQUIRE); c != NULL; c = c->next) {
+    total->n_malloc += c->n_malloc;
+    total->n_calloc += c->n_calloc;
+    total->n_realloc += c->n_realloc;
+    total->n_allocb += c->n_allocb;
+    total->n_freeb += c->n_freeb;
+    total->n_samples += c->n_samples;
+    total->est_allocb += c->est_allocb;
+    total->est_freeb += c->est_freeb;
+    hist_merge(&total->sizes, &c->sizes);
+    hist_merge(&total->life_ops, &c->life_ops);
+    hist_merge(&total->life_ns, &c->life_ns);
+    hist_merge(&total->growth, &c->growth);
+  }
+}
+
+//
+// the state of a snapshot being written: the blocks written so far, and
+// the live blocks per call stack. The first block visited sets up the
+// rest, since every block of the snapshot has been copied by then:
+// their stacks are below stack_count(), and they were born before now.
+//
+typedef struct __snap {
+  FILE *f;
+  unsigned long n;
+  double bytes, blocks;
+  uint64_t now, ops;
+  stack_live *live;
+  unsigned int *ids, n_stacks;
+  size_t live_bytes;
+} snap;
+
+//
+// json_string - write a string as JSON
+//
+static void json_string(FILE *f, const char *str)
+{
+  fputc('"', f);
+  for (; *str; str++) {
+    if ((*str == '"') || (*str == '\\')) fprintf(f, "\\%c", *str);
+    else if ((unsigned char)*str < ' ') fprintf(f, "\\u%04x", *str);
+    else fputc(*str, f);
+  }
+  fputc('"', f);
+}
+
+//
+// snap_block - write a block of the snapshot that has not been freed
+//
+static void snap_block(item *i, void *arg)
+{
+  snap *s = arg;
+  double w = (sample_mean > 0) ? weight(i->size) : 1;
+
+  if (i->cnt <= 0) return;
+
+  if (s->n == 0) {
+    s->now = now_ns();
+    s->ops = __atomic_load_n(&ops, __ATOMIC_RELAXED);
+    if (stack_depth > 0) {
+      s->n_stacks = stack_count();
+      s->live = new_stack_live(s->n_stacks, &s->ids, &s->live_bytes);
+    }
+  }
+
+  fprintf(s->f, "%s\n    { \"ptr\": \"%p\", \"size\": %zu, \"stack\": %u, "
+          "\"age_ops\": %llu, \"age_ns\": %llu }", s->n ? "," : "",
+          i->ptr, i->size, i->stack, (unsigned long long)(s->ops - i->op),
+          (unsigned long long)(s->now - i->ns));
+  s->n++;
+  s->bytes += w * i->size;
+  s->blocks += w;
+  if (s->live != NULL) add_stack(i, s->live);
+}
+
+//
+// snap_stacks - write the stacks with live blocks, most live bytes first
+// (none if no block was visited)
+//
+static void snap_stacks(snap *s)
+{
+  char name[256];
+  unsigned int i;
+  int k;
+
+  sort_stacks(s->ids, s->n_stacks, s->live);
+
+  fprintf(s->f, ",\n  \"stacks\": [");
+  for (i = 0; (i < s->n_stacks) && (s->live[s->ids[i]].blocks > 0); i++) {
+    const stack *st = stack_get(s->ids[i]);
+
+    fprintf(s->f, "%s\n    { \"id\": %u, \"live_bytes\": %.0f, \"live_blocks\": %.0f, "
+            "\"allocs\": %lu, \"bytes\": %lu, \"frames\": [", i ? "," : "", s->ids[i],
+            s->live[s->ids[i]].bytes, s->live[s->ids[i]].blocks, st->allocs, st->bytes);
+    for (k = 0; k < (int)st->depth; k++) {
+      fputs(k ? ", " : " ", s->f);
+      json_string(s->f, stack_symbol(st->frames[k], name, sizeof(name)));
+    }
+    fprintf(s->f, "%s] }", st->depth ? " " : "");
+  }
+  fprintf(s->f, "%s]", i ? "\n  " : "");
+}
+
+//
+// report - write a snapshot of the program as JSON to a client of the
+// control socket; runs on the server thread, whose allocations are the
+// tracer's
+//
+static void report(int fd)
+{
+  counters total = { 0 };
+  snap s = { 0 };
+  struct timespec now;
+
+  in_tracer = 1;
+  if ((fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0) return;
+  if ((s.f = fdopen(fd, "w")) == NULL) {
+    close(fd);
+    return;
+  }
+
+  sum_counters(&total);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  fprintf(s.f, "{\n  \"pid\": %d,\n  \"uptime_ns\": %lld,\n", (int)getpid(),
+          (now.tv_sec - started.tv_sec) * 1000000000LL + (now.tv_nsec - started.tv_nsec));
+  json_stats(s.f, &total);
+  fprintf(s.f, ",\n  \"freed_total\": %lu,\n  \"blocks\": [", total.n_freeb);
+  walk_snapshot(list, snap_block, &s);
+  fprintf(s.f, "%s],\n  \"live\": { \"blocks\": %.0f, \"bytes\": %.0f }",
+          s.n ? "\n  " : "", s.blocks, s.bytes);
+  if (stack_depth > 0) snap_stacks(&s);
+  if (s.live != NULL) munmap(s.live, s.live_bytes);
+  fprintf(s.f, "\n}\n");
+
+  fclose(s.f);
+}
+
+//
+// heap_block - add a block of the snapshot that has not been freed
+//
+static void heap_block(item *i, void *arg)
+{
+  if (i->cnt > 0) heap_add(arg, i->stack, i->size, (sample_mean > 0) ? weight(i->size) : 1);
+}
+
+//
+// take_snapshot - write the next heap snapshot; runs on the snapshot
+// thread, whose allocations are the tracer's, or at fini
+//
+static void take_snapshot(void)
+{
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static uint64_t seq = 0;
+  heap_header hdr = { 0 };
+  counters total = { 0 };
+  struct timespec now;
+  char path[4096];
+  heap *h;
+
+  in_tracer = 1;
+  pthread_mutex_lock(&lock);
+
+  h = heap_new();
+  walk_snapshot(list, heap_block, h);
+  sum_counters(&total);
+
+  hdr.pid = getpid();
+  hdr.seq = ++seq;
+  clock_gettime(CLOCK_REALTIME, &now);
+  hdr.time_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  hdr.uptime_ns = (now.tv_sec - started.tv_sec) * 1000000000LL + (now.tv_nsec - started.tv_nsec);
+  hdr.sample_interval = sample_mean;
+  hdr.allocated = (sample_mean > 0) ? total.est_allocb : total.n_allocb;
+  hdr.freed = (sample_mean > 0) ? total.est_freeb : total.n_freeb;
+
+  snprintf(path, sizeof(path), "%s.%d.%04llu.heap", snapshot_prefix, (int)hdr.pid,
+           (unsigned long long)hdr.seq);
+  if (heap_write(h, &hdr, path) < 0) {
+    mlog("Error writing heap snapshot '%s': %s", path, strerror(errno));
+  }
+  heap_free(h);
+
+  pthread_mutex_unlock(&lock);
 }
 
 //
@@ -54,122 +867,277 @@ void init(void)
 __attribute__((destructor))
 void fini(void)
 {
-  // ...
+  counters total = { 0 };
+  int nonfreed;
 
-  LOG_STATISTICS((long)n_allocb, (long)(n_allocb/(n_malloc + n_calloc + n_realloc)), n_freeb);
+  in_tracer = 1;
+  serve_stop();
 
-  if (n_allocb != n_freeb) {
+  sum_counters(&total);
+
+  if (sample_mean > 0) {
+    nonfreed = log_sampling(&total);
+  }
+  else {
+    LOG_STATISTICS((long)total.n_allocb,
+                   (long)(total.n_allocb/(total.n_malloc + total.n_calloc + total.n_realloc)),
+                   total.n_freeb);
+    nonfreed = total.n_allocb != total.n_freeb;
+  }
+  log_histograms(&total);
+
+  if (nonfreed) {
     LOG_NONFREED_START();
 
-    item *prev = list, *cur = prev->next;
-    while(cur != NULL) {
-      if (cur->cnt > 0) {
-        LOG_BLOCK(cur->ptr, cur->size, cur->cnt);
-      }
-      prev = cur;
-      cur = cur->next;
-    }
+    walk_list(list, log_block, NULL);
   }
+  log_stacks();
+  if (snapshot_prefix != NULL) take_snapshot();
 
   LOG_STOP();
 
-  // free list (not needed for part 1)
-  free_list(list);
+  // the list is left in place: threads still running may use it
+
+  in_tracer = 0;
 }
 
 // ...
 
-void *malloc(size_t size) {
-  void *ptr;
-  char *err;
+//
+// enter - start the work of a wrapper called by the program, counting
+// the call on the clock of the lifetimes
+//
+static void enter(void)
+{
+  in_tracer = 1;
+  resolve();
+  __atomic_fetch_add(&ops, 1, __ATOMIC_RELAXED);
+}
 
-  if (!mallocp) {
-    mallocp = dlsym(RTLD_NEXT, "malloc");
+//
+// own_alloc - allocate size bytes aligned to align for the tracer: from
+// the bootstrap arena, whose memory is zeroed, or from libc once the
+// arena is used up, adding the block to own_list
+//
+static void *own_alloc(size_t size, size_t align, int zero)
+{
+  void *ptr = arena_alloc(size, align);
 
-    if ((err = dlerror()) != NULL) {
-      mlog(err);
-      exit(1);
+  if ((ptr == NULL) && (memalignp != NULL) && (own_list != NULL)) {
+    ptr = memalignp(align > 16 ? align : 16, size);
+    if (ptr != NULL) {
+      if (zero) memset(ptr, 0, size);
+      alloc(own_list, ptr, size);
+      __atomic_fetch_add(&own_blocks, 1, __ATOMIC_RELEASE);
     }
   }
 
+  return ptr;
+}
+
+//
+// owned - whether ptr is a block of the tracer: of the arena, or one
+// libc gave it
+//
+static int owned(void *ptr)
+{
+  return in_arena(ptr) || ((ptr != NULL) &&
+         (__atomic_load_n(&own_blocks, __ATOMIC_ACQUIRE) > 0) && (find(own_list, ptr) != NULL));
+}
+
+//
+// own_realloc, own_free - realloc and free of a block of the tracer, or
+// of the arena (which may have been handed on to the program); a block
+// of own_list leaves it
+//
+static void *own_realloc(void *ptr, size_t size)
+{
+  void *new_ptr;
+
+  if ((ptr != NULL) && !in_arena(ptr)) {
+    if (reallocp == NULL) return NULL;
+    new_ptr = reallocp(ptr, size);
+    if ((new_ptr != NULL) && forget(own_list, ptr)) alloc(own_list, new_ptr, size);
+    return new_ptr;
+  }
+
+  new_ptr = own_alloc(size, 0, 0);
+  if ((new_ptr != NULL) && (ptr != NULL)) {
+    memcpy(new_ptr, ptr, arena_size(ptr) < size ? arena_size(ptr) : size);
+  }
+
+  return new_ptr;
+}
+
+static void own_free(void *ptr)
+{
+  if (in_arena(ptr) || (freep == NULL)) return;
+
+  if ((__atomic_load_n(&own_blocks, __ATOMIC_ACQUIRE) > 0) && forget(own_list, ptr)) {
+    __atomic_fetch_sub(&own_blocks, 1, __ATOMIC_RELAXED);
+  }
+  freep(ptr);
+}
+
+//
+// allocated - count a block of size bytes returned by one of the
+// malloc-like functions; returns whether it is traced
+//
+static int allocated(size_t size)
+{
+  counters *c = stats();
+
+  c->n_malloc++;
+  c->n_allocb += size;
+  hist_add(&c->sizes, size, 1);
+
+  return traced(c, size);
+}
+
+void *malloc(size_t size) {
+  void *ptr;
+
+  if (in_tracer) return own_alloc(size, 0, 0);
+  enter();
+
   ptr = mallocp(size);
-  if (ptr != NULL) {
+  if ((ptr != NULL) && allocated(size)) {
     LOG_MALLOC(size, ptr);
-    n_malloc++;
-    n_allocb += size;
-
-    alloc(list, ptr, size);
+    track(ptr, size, __builtin_frame_address(0), NULL);
   }
 
+  in_tracer = 0;
   return ptr;
 }
 
 void *calloc(size_t num, size_t size) {
   void *ptr;
-  char *err;
-
-  if (!callocp) {
-    callocp = dlsym(RTLD_NEXT, "calloc");
+  size_t bytes;
+  counters *c;
 
-    if ((err = dlerror()) != NULL) {
-      mlog(err);
-      exit(1);
-    }
-  }
+  // dlsym allocates while the functions are being resolved
+  if (in_tracer) return __builtin_mul_overflow(num, size, &bytes) ? NULL : own_alloc(bytes, 0, 1);
+  enter();
 
   ptr = callocp(num, size);
   if (ptr != NULL) {
-    LOG_CALLOC(num, size, ptr);
-    n_calloc++;
-    n_allocb += num * size;
+    c = stats();
+    c->n_calloc++;
+    c->n_allocb += num * size;
+    hist_add(&c->sizes, num * size, 1);
 
-    alloc(list, ptr, num * size);
+    if (traced(c, num * size)) {
+      LOG_CALLOC(num, size, ptr);
+      track(ptr, num * size, __builtin_frame_address(0), NULL);
+    }
   }
 
+  in_tracer = 0;
   return ptr;
 }
 
-void *realloc(void *ptr, size_t new_size) {
+static void log_resize(int op, void *ptr, size_t nmemb, size_t size, void *res)
+{
+  if (op == EV_REALLOCARRAY) LOG_REALLOCARRAY(ptr, nmemb, size, res);
+  else LOG_REALLOC(ptr, size, res);
+}
+
+//
+// resize - realloc, or reallocarray (op) of nmemb elements of size
+// bytes, fp being the frame of the wrapper
+//
+static void *resize(void *ptr, size_t nmemb, size_t size, int op, void *fp)
+{
   void *new_ptr;
-  char *err;
-  item *freed_block;
-  if (!reallocp) {
-    reallocp = dlsym(RTLD_NEXT, "realloc");
+  size_t new_size = nmemb * size;
+  item *freed_block, *born;
+  counters *c;
 
-    if ((err = dlerror()) != NULL) {
-      mlog(err);
-      exit(1);
-    }
-  }
+  enter();
 
+  // the old block is marked freed before libc may hand its address to
+  // another thread, and marked allocated again if realloc fails
+  freed_block = (sample_mean > 0) ? untrace(ptr) : dealloc(list, ptr);
+  born = ((freed_block != NULL) && ((sample_mean > 0) || (freed_block->cnt >= 0))) ?
+         freed_block : NULL;
   new_ptr = reallocp(ptr, new_size);
   if (new_ptr != NULL) {
-    LOG_REALLOC(ptr, new_size, new_ptr);
-    n_realloc++;
-    n_allocb += new_size;
+    c = stats();
+    c->n_realloc++;
+    c->n_allocb += new_size;
+    hist_add(&c->sizes, new_size, 1);
 
-    freed_block = dealloc(list, ptr);
-    n_freeb += freed_block->size;
-    alloc(list, new_ptr, new_size);
+    if (freed_block != NULL) c->n_freeb += freed_block->size;
+    if (born != NULL) grow(c, born, new_size);
+    if (traced(c, new_size)) {
+      log_resize(op, ptr, nmemb, size, new_ptr);
+      track(new_ptr, new_size, fp, born);
+    }
+    else if (freed_block != NULL) {
+      // a sampled block moved out of the sample; it still lives, so
+      // its lifetime is not known
+      log_resize(op, ptr, nmemb, size, new_ptr);
+    }
+  }
+  else if (freed_block != NULL) {
+    if (sample_mean > 0) stats()->est_freeb -= weight(freed_block->size) * freed_block->size;
+    alloc_item(list, freed_block);
   }
 
+  in_tracer = 0;
   return new_ptr;
 }
 
-void free(void* ptr) {
-  char *err;
+void *realloc(void *ptr, size_t new_size) {
+  if (in_tracer || owned(ptr)) return own_realloc(ptr, new_size);
+
+  return resize(ptr, 1, new_size, EV_REALLOC, __builtin_frame_address(0));
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+  size_t new_size;
+
+  if (__builtin_mul_overflow(nmemb, size, &new_size)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (in_tracer || owned(ptr)) return own_realloc(ptr, new_size);
+
+  return resize(ptr, nmemb, size, EV_REALLOCARRAY, __builtin_frame_address(0));
+}
+
+static void log_discard(int op, void *ptr, size_t size)
+{
+  if (op == EV_DELETE) LOG_DELETE(ptr, size);
+  else if (op == EV_DELETE_ARRAY) LOG_DELETE_ARRAY(ptr, size);
+  else LOG_FREE(ptr);
+}
+
+//
+// discard - free, or operator delete (op) being passed size if it is
+// the sized one
+//
+static void discard(void *ptr, int op, size_t size)
+{
   item *freed_item;
-  if (!freep) {
-    freep = dlsym(RTLD_NEXT, "free");
+  counters *c;
 
-    if ((err = dlerror()) != NULL) {
-      mlog(err);
-      exit(1);
+  enter();
+
+  if (sample_mean > 0) {
+    if ((freed_item = untrace(ptr)) != NULL) {
+      log_discard(op, ptr, size);
+      retire(stats(), freed_item);
     }
+    freep(ptr);
+    in_tracer = 0;
+    return;
   }
 
-  LOG_FREE(ptr);
-  freed_item = find(list, ptr);
+  log_discard(op, ptr, size);
+  // checking and marking the block is one step, and happens before libc
+  // may hand its address to another thread
+  freed_item = release(list, ptr);
   if (freed_item == NULL) {
     LOG_ILL_FREE();
   }
@@ -177,8 +1145,246 @@ void free(void* ptr) {
     LOG_DOUBLE_FREE();
   }
   else {
+    c = stats();
+    c->n_freeb += freed_item->size;
+    retire(c, freed_item);
     freep(ptr);
-    freed_item = dealloc(list, ptr);
-    n_freeb += freed_item->size;
   }
+
+  in_tracer = 0;
+}
+
+void free(void* ptr) {
+  if (in_tracer || owned(ptr)) {
+    own_free(ptr);
+    return;
+  }
+
+  discard(ptr, EV_FREE, 0);
+}
+
+//
+// the aligned allocation functions; their blocks are freed with free
+//
+int posix_memalign(void **res, size_t align, size_t size) {
+  int err;
+
+  if (in_tracer) return ((*res = own_alloc(size, align, 0)) != NULL) ? 0 : ENOMEM;
+  enter();
+
+  err = posix_memalignp(res, align, size);
+  if ((err == 0) && allocated(size)) {
+    LOG_POSIX_MEMALIGN(align, size, *res);
+    track(*res, size, __builtin_frame_address(0), NULL);
+  }
+
+  in_tracer = 0;
+  return err;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+  void *ptr;
+
+  if (in_tracer) return own_alloc(size, align, 0);
+  enter();
+
+  ptr = aligned_allocp(align, size);
+  if ((ptr != NULL) && allocated(size)) {
+    LOG_ALIGNED_ALLOC(align, size, ptr);
+    track(ptr, size, __builtin_frame_address(0), NULL);
+  }
+
+  in_tracer = 0;
+  return ptr;
+}
+
+void *memalign(size_t align, size_t size) {
+  void *ptr;
+
+  if (in_tracer) return own_alloc(size, align, 0);
+  enter();
+
+  ptr = memalignp(align, size);
+  if ((ptr != NULL) && allocated(size)) {
+    LOG_MEMALIGN(align, size, ptr);
+    track(ptr, size, __builtin_frame_address(0), NULL);
+  }
+
+  in_tracer = 0;
+  return ptr;
+}
+
+void *valloc(size_t size) {
+  void *ptr;
+
+  if (in_tracer) return own_alloc(size, getpagesize(), 0);
+  enter();
+
+  ptr = vallocp(size);
+  if ((ptr != NULL) && allocated(size)) {
+    LOG_VALLOC(size, ptr);
+    track(ptr, size, __builtin_frame_address(0), NULL);
+  }
+
+  in_tracer = 0;
+  return ptr;
+}
+
+void *pvalloc(size_t size) {
+  void *ptr;
+
+  if (in_tracer) {
+    return own_alloc((size + getpagesize() - 1) & ~(size_t)(getpagesize() - 1), getpagesize(), 0);
+  }
+  enter();
+
+  ptr = pvallocp(size);
+  if ((ptr != NULL) && allocated(size)) {
+    LOG_PVALLOC(size, ptr);
+    track(ptr, size, __builtin_frame_address(0), NULL);
+  }
+
+  in_tracer = 0;
+  return ptr;
+}
+
+//
+// C++'s operator new and delete, defined by their mangled names
+//
+// new allocates with malloc or memalign, so it cannot throw by itself:
+// when that fails, libstdc++'s operator new takes over to call the new
+// handler and to throw (or, for the nothrow versions, return NULL).
+// delete of NULL does nothing and is not logged.
+//
+static void *new_block(size_t size, size_t align, int op, void *fp)
+{
+  void *ptr;
+
+  enter();
+
+  ptr = align ? memalignp(align, size) : mallocp(size);
+  if ((ptr != NULL) && allocated(size)) {
+    if (op == EV_NEW_ARRAY) LOG_NEW_ARRAY(size, align, ptr);
+    else LOG_NEW(size, align, ptr);
+    track(ptr, size, fp, NULL);
+  }
+
+  in_tracer = 0;
+  return ptr;
+}
+
+//
+// libstdc++'s definition of an operator, looked up when new fails
+//
+static void *cxx(const char *name)
+{
+  int nested = in_tracer;
+  void *p;
+
+  in_tracer = 1;
+  p = sym(name);
+  in_tracer = nested;
+
+  return p;
+}
+
+static void delete_block(void *ptr, int op, size_t size)
+{
+  if (ptr == NULL) return;
+  if (in_tracer || owned(ptr)) {
+    own_free(ptr);
+    return;
+  }
+
+  discard(ptr, op, size);
+}
+
+// operator new(size_t)
+void *_Znwm(size_t size) {
+  void *ptr = in_tracer ? NULL : new_block(size, 0, EV_NEW, __builtin_frame_address(0));
+
+  return ptr ? ptr : ((void *(*)(size_t))cxx("_Znwm"))(size);
+}
+
+// operator new[](size_t)
+void *_Znam(size_t size) {
+  void *ptr = in_tracer ? NULL : new_block(size, 0, EV_NEW_ARRAY, __builtin_frame_address(0));
+
+  return ptr ? ptr : ((void *(*)(size_t))cxx("_Znam"))(size);
+}
+
+// operator new(size_t, const std::nothrow_t&)
+void *_ZnwmRKSt9nothrow_t(size_t size, const void *nt) {
+  void *ptr = in_tracer ? NULL : new_block(size, 0, EV_NEW, __builtin_frame_address(0));
+
+  return ptr ? ptr : ((void *(*)(size_t, const void*))cxx("_ZnwmRKSt9nothrow_t"))(size, nt);
+}
+
+// operator new[](size_t, const std::nothrow_t&)
+void *_ZnamRKSt9nothrow_t(size_t size, const void *nt) {
+  void *ptr = in_tracer ? NULL : new_block(size, 0, EV_NEW_ARRAY, __builtin_frame_address(0));
+
+  return ptr ? ptr : ((void *(*)(size_t, const void*))cxx("_ZnamRKSt9nothrow_t"))(size, nt);
+}
+
+// operator new(size_t, std::align_val_t)
+void *_ZnwmSt11align_val_t(size_t size, size_t align) {
+  void *ptr = in_tracer ? NULL : new_block(size, align, EV_NEW, __builtin_frame_address(0));
+
+  return ptr ? ptr : ((void *(*)(size_t, size_t))cxx("_ZnwmSt11align_val_t"))(size, align);
+}
+
+// operator new[](size_t, std::align_val_t)
+void *_ZnamSt11align_val_t(size_t size, size_t align) {
+  void *ptr = in_tracer ? NULL : new_block(size, align, EV_NEW_ARRAY, __builtin_frame_address(0));
+
+  return ptr ? ptr : ((void *(*)(size_t, size_t))cxx("_ZnamSt11align_val_t"))(size, align);
+}
+
+// operator new(size_t, std::align_val_t, const std::nothrow_t&)
+void *_ZnwmSt11align_val_tRKSt9nothrow_t(size_t size, size_t align, const void *nt) {
+  void *ptr = in_tracer ? NULL : new_block(size, align, EV_NEW, __builtin_frame_address(0));
+
+  return ptr ? ptr : ((void *(*)(size_t, size_t, const void*))
+                      cxx("_ZnwmSt11align_val_tRKSt9nothrow_t"))(size, align, nt);
+}
+
+// operator new[](size_t, std::align_val_t, const std::nothrow_t&)
+void *_ZnamSt11align_val_tRKSt9nothrow_t(size_t size, size_t align, const void *nt) {
+  void *ptr = in_tracer ? NULL : new_block(size, align, EV_NEW_ARRAY, __builtin_frame_address(0));
+
+  return ptr ? ptr : ((void *(*)(size_t, size_t, const void*))
+                      cxx("_ZnamSt11align_val_tRKSt9nothrow_t"))(size, align, nt);
+}
+
+// operator delete(void*), delete[](void*)
+void _ZdlPv(void *ptr) { delete_block(ptr, EV_DELETE, 0); }
+void _ZdaPv(void *ptr) { delete_block(ptr, EV_DELETE_ARRAY, 0); }
+
+// operator delete(void*, size_t), delete[](void*, size_t)
+void _ZdlPvm(void *ptr, size_t size) { delete_block(ptr, EV_DELETE, size); }
+void _ZdaPvm(void *ptr, size_t size) { delete_block(ptr, EV_DELETE_ARRAY, size); }
+
+// operator delete(void*, const std::nothrow_t&), delete[](...)
+void _ZdlPvRKSt9nothrow_t(void *ptr, const void *nt) { delete_block(ptr, EV_DELETE, 0); }
+void _ZdaPvRKSt9nothrow_t(void *ptr, const void *nt) { delete_block(ptr, EV_DELETE_ARRAY, 0); }
+
+// operator delete(void*, std::align_val_t), delete[](...)
+void _ZdlPvSt11align_val_t(void *ptr, size_t align) { delete_block(ptr, EV_DELETE, 0); }
+void _ZdaPvSt11align_val_t(void *ptr, size_t align) { delete_block(ptr, EV_DELETE_ARRAY, 0); }
+
+// operator delete(void*, size_t, std::align_val_t), delete[](...)
+void _ZdlPvmSt11align_val_t(void *ptr, size_t size, size_t align) {
+  delete_block(ptr, EV_DELETE, size);
+}
+void _ZdaPvmSt11align_val_t(void *ptr, size_t size, size_t align) {
+  delete_block(ptr, EV_DELETE_ARRAY, size);
+}
+
+// operator delete(void*, std::align_val_t, const std::nothrow_t&), delete[](...)
+void _ZdlPvSt11align_val_tRKSt9nothrow_t(void *ptr, size_t align, const void *nt) {
+  delete_block(ptr, EV_DELETE, 0);
+}
+void _ZdaPvSt11align_val_tRKSt9nothrow_t(void *ptr, size_t align, const void *nt) {
+  delete_block(ptr, EV_DELETE_ARRAY, 0);
 }
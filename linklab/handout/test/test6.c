@@ -0,0 +1,61 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS 8
+#define ROUNDS  2000
+#define SLOTS   64
+
+//
+// blocks handed from one thread to the next, to be freed there
+//
+static void *mailbox[THREADS];
+
+static void *worker(void *arg)
+{
+  long id = (long)arg;
+  unsigned int seed = (unsigned int)id + 1;
+  void *slot[SLOTS] = { NULL };
+  void *mail;
+  int i, k;
+
+  for (i = 0; i < ROUNDS; i++) {
+    k = rand_r(&seed) % SLOTS;
+    switch (rand_r(&seed) % 4) {
+      case 0:
+        free(slot[k]);
+        slot[k] = malloc(rand_r(&seed) % 256 + 1);
+        break;
+      case 1:
+        free(slot[k]);
+        slot[k] = calloc(rand_r(&seed) % 8 + 1, 16);
+        break;
+      case 2:
+        slot[k] = realloc(slot[k], rand_r(&seed) % 512 + 1);
+        break;
+      case 3:
+        // pass a block on, and free whatever the previous thread left
+        mail = __atomic_exchange_n(&mailbox[(id + 1) % THREADS], slot[k], __ATOMIC_ACQ_REL);
+        slot[k] = NULL;
+        free(mail);
+        break;
+    }
+    if (slot[k] != NULL) memset(slot[k], 0, 1);
+  }
+
+  for (k = 0; k < SLOTS; k++) free(slot[k]);
+
+  return NULL;
+}
+
+int main(void)
+{
+  pthread_t tid[THREADS];
+  long i;
+
+  for (i = 0; i < THREADS; i++) pthread_create(&tid[i], NULL, worker, (void*)i);
+  for (i = 0; i < THREADS; i++) pthread_join(tid[i], NULL);
+  for (i = 0; i < THREADS; i++) free(mailbox[i]);
+
+  return 0;
+}
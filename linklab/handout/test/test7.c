@@ -0,0 +1,34 @@
+#define _GNU_SOURCE
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int main(void)
+{
+  void *a, *b, *c, *d, *e, *f;
+  char *s, *t;
+
+  posix_memalign(&a, 64, 100);
+  b = aligned_alloc(256, 512);
+  c = memalign(4096, 10);
+  d = valloc(1000);
+  e = pvalloc(100);
+  f = reallocarray(NULL, 10, 8);
+  f = reallocarray(f, 100, 8);
+
+  // libc's own allocations go through malloc
+  s = strdup("memtrace");
+  t = strndup(s, 3);
+
+  free(a);
+  free(b);
+  free(c);
+  free(d);
+  free(e);
+  free(f);
+  free(s);
+  free(t);
+
+  return 0;
+}
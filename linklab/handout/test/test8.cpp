@@ -0,0 +1,32 @@
+#include <new>
+#include <string>
+#include <vector>
+
+struct alignas(64) line {
+  char data[64];
+};
+
+int main(void)
+{
+  int *a = new int;
+  int *b = new int[100];
+  int *c = new (std::nothrow) int[10];
+  line *d = new line;
+  line *e = new line[4];
+  std::vector<int> v;
+  std::string *s = new std::string(100, 'x');
+
+  for (int i = 0; i < 1000; i++) v.push_back(i);
+
+  delete a;
+  delete[] b;
+  delete[] c;
+  delete d;
+  delete[] e;
+  delete s;
+
+  // never deleted
+  new int[25];
+
+  return 0;
+}
@@ -0,0 +1,227 @@
+//------------------------------------------------------------------------------
+//
+// memdecode
+//
+// decode a binary event log written by memtrace with MEMTRACE_LOG set
+// into the text the tracer prints, and compute the statistics, the
+// histograms and the non-deallocated blocks the way part 3's fini does
+//
+//   usage: memdecode <log>
+//
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <memlog.h>
+#include <memlist.h>
+#include <memhist.h>
+
+//
+// realloc growth ratios are kept in units of 1/GROWTH_SCALE, as by part 3
+//
+#define GROWTH_SCALE 256
+
+//
+// log_block - log a block that has not been freed
+//
+static void log_block(item *i, void *arg)
+{
+  if (i->cnt > 0) {
+    LOG_BLOCK(i->ptr, i->size, i->cnt);
+  }
+}
+
+//
+// track - add a block allocated by the n-th call at time ns (a block
+// realloc'd from born keeps its birth)
+//
+static void track(memlist *list, void *ptr, size_t size, uint64_t n, uint64_t ns,
+                  const item *born)
+{
+  item it = { ptr, size, 0, 0, n, ns };
+
+  if (born != NULL) {
+    it.op = born->op;
+    it.ns = born->ns;
+  }
+  alloc_item(list, &it);
+}
+
+static int by_seq(const void *a, const void *b)
+{
+  const mevent *x = a, *y = b;
+
+  return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long n_malloc = 0, n_calloc = 0, n_realloc = 0;
+  unsigned long n_allocb = 0, n_freeb = 0, n_calls;
+  hist sizes = { { 0 } }, life_ops = { { 0 } }, life_ns = { { 0 } }, growth = { { 0 } };
+  uint64_t ops = 0;
+  const mevent_header *h;
+  const mevent *log;
+  mevent *ev;
+  memlist *list;
+  item *it;
+  struct stat st;
+  size_t i, n, cnt;
+  int fd;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <log>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // the decoder's own logging is text, whatever the environment says
+  unsetenv("MEMTRACE_LOG");
+  mlog_file = stdout;
+
+  fd = open(argv[1], O_RDONLY);
+  if ((fd < 0) || (fstat(fd, &st) < 0)) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+  if ((size_t)st.st_size < sizeof(mevent_header)) {
+    fprintf(stderr, "%s: not an event log\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  h = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (h == MAP_FAILED) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+  if ((memcmp(h->magic, MEVENT_MAGIC, sizeof(h->magic)) != 0) ||
+      (h->version != MEVENT_VERSION) || (h->event_size != sizeof(mevent))) {
+    fprintf(stderr, "%s: not an event log of this version\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  // the threads' events are interleaved in the file: put them in order,
+  // leaving out the unused tail of a log that was not closed
+  log = (const mevent*)(h + 1);
+  n = (st.st_size - sizeof(mevent_header)) / sizeof(mevent);
+  ev = malloc((n ? n : 1) * sizeof(mevent));
+  if (ev == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return EXIT_FAILURE;
+  }
+  for (i = cnt = 0; i < n; i++) {
+    if (log[i].op != EV_NONE) ev[cnt++] = log[i];
+  }
+  qsort(ev, cnt, sizeof(mevent), by_seq);
+
+  list = new_list();
+  for (i = 0; i < cnt; i++) {
+    void *ptr = (void*)(uintptr_t)ev[i].ptr, *res = (void*)(uintptr_t)ev[i].res;
+    size_t size = ev[i].size, nmemb = ev[i].nmemb;
+    uint64_t ts = ev[i].ts;
+
+    if ((ev[i].op != EV_START) && (ev[i].op != EV_DOUBLE_FREE) && (ev[i].op != EV_ILL_FREE)) {
+      ops++;
+    }
+
+    switch (ev[i].op) {
+      case EV_START:
+        LOG_START();
+        break;
+      case EV_MALLOC:
+      case EV_POSIX_MEMALIGN:
+      case EV_ALIGNED_ALLOC:
+      case EV_MEMALIGN:
+      case EV_VALLOC:
+      case EV_PVALLOC:
+      case EV_NEW:
+      case EV_NEW_ARRAY:
+        switch (ev[i].op) {
+          case EV_MALLOC:         LOG_MALLOC(size, res); break;
+          case EV_POSIX_MEMALIGN: LOG_POSIX_MEMALIGN(nmemb, size, res); break;
+          case EV_ALIGNED_ALLOC:  LOG_ALIGNED_ALLOC(nmemb, size, res); break;
+          case EV_MEMALIGN:       LOG_MEMALIGN(nmemb, size, res); break;
+          case EV_VALLOC:         LOG_VALLOC(size, res); break;
+          case EV_PVALLOC:        LOG_PVALLOC(size, res); break;
+          case EV_NEW:            LOG_NEW(size, nmemb, res); break;
+          case EV_NEW_ARRAY:      LOG_NEW_ARRAY(size, nmemb, res); break;
+        }
+        n_malloc++;
+        n_allocb += size;
+        hist_add(&sizes, size, 1);
+        track(list, res, size, ops, ts, NULL);
+        break;
+      case EV_CALLOC:
+        LOG_CALLOC(nmemb, size, res);
+        n_calloc++;
+        n_allocb += nmemb * size;
+        hist_add(&sizes, nmemb * size, 1);
+        track(list, res, nmemb * size, ops, ts, NULL);
+        break;
+      case EV_REALLOC:
+      case EV_REALLOCARRAY:
+        if (ev[i].op == EV_REALLOCARRAY) {
+          LOG_REALLOCARRAY(ptr, nmemb, size, res);
+          size *= nmemb;
+        }
+        else {
+          LOG_REALLOC(ptr, size, res);
+        }
+        n_realloc++;
+        n_allocb += size;
+        hist_add(&sizes, size, 1);
+        if ((it = dealloc(list, ptr)) != NULL) n_freeb += it->size;
+        if ((it != NULL) && (it->cnt < 0)) it = NULL;
+        if ((it != NULL) && (it->size > 0)) hist_add(&growth, size * GROWTH_SCALE / it->size, 1);
+        track(list, res, size, ops, ts, it);
+        break;
+      case EV_FREE:
+      case EV_DELETE:
+      case EV_DELETE_ARRAY:
+        if (ev[i].op == EV_DELETE) LOG_DELETE(ptr, size);
+        else if (ev[i].op == EV_DELETE_ARRAY) LOG_DELETE_ARRAY(ptr, size);
+        else LOG_FREE(ptr);
+        it = find(list, ptr);
+        if ((it != NULL) && (it->cnt > 0)) {
+          it = dealloc(list, ptr);
+          n_freeb += it->size;
+          hist_add(&life_ops, ops - it->op, 1);
+          hist_add(&life_ns, ts - it->ns, 1);
+        }
+        break;
+      case EV_DOUBLE_FREE:
+        LOG_DOUBLE_FREE();
+        break;
+      case EV_ILL_FREE:
+        LOG_ILL_FREE();
+        break;
+      default:
+        fprintf(stderr, "%s: unknown event %u\n", argv[1], ev[i].op);
+        break;
+    }
+  }
+
+  n_calls = n_malloc + n_calloc + n_realloc;
+  LOG_STATISTICS((long)n_allocb, (long)(n_calls ? n_allocb/n_calls : 0), n_freeb);
+  hist_log("Allocation sizes (bytes)", &sizes, 1);
+  hist_log("Lifetimes (calls)", &life_ops, 1);
+  hist_log("Lifetimes (ns)", &life_ns, 1);
+  hist_log("Realloc growth (new/old size)", &growth, GROWTH_SCALE);
+
+  if (n_allocb != n_freeb) {
+    LOG_NONFREED_START();
+    walk_list(list, log_block, NULL);
+  }
+
+  LOG_STOP();
+
+  free_list(list);
+  free(ev);
+  munmap((void*)h, st.st_size);
+  close(fd);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,320 @@
+//------------------------------------------------------------------------------
+//
+// memdiff
+//
+// compare two heap snapshots written by memtrace with MEMTRACE_SNAPSHOT
+// set, and report the call sites whose live bytes grew the most from
+// the first to the second, broken down by size class; a site that keeps
+// growing between snapshots is where a leak allocates
+//
+//   usage: memdiff [-n <sites>] <old> <new>
+//
+//   -n         number of sites reported (default 10, 0 for all)
+//
+// A call site is the call stack of the allocations, by frame names, so
+// snapshots of different runs of a program can be compared as well.
+//
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <memheap.h>
+
+//
+// a snapshot read from a file
+//
+//   hdr        its header
+//   ids        ids of its stacks, in increasing order
+//   sites      site of each stack: its frames separated by newlines
+//   entries    its entries
+//   blocks     live blocks and bytes, summed over the entries
+//
+typedef struct __snapshot {
+  const char *path;
+  heap_header hdr;
+  uint32_t *ids;
+  char **sites;
+  heap_entry *entries;
+  double blocks, bytes;
+} snapshot;
+
+//
+// the live blocks and bytes of a site and size class (or of a site in
+// all size classes) in the old and the new snapshot
+//
+typedef struct __row {
+  const char *site;
+  uint32_t size_class;
+  double blocks[2];
+  double bytes[2];
+} row;
+
+static void fail(const char *path, const char *what)
+{
+  fprintf(stderr, "%s: %s\n", path, what);
+  exit(EXIT_FAILURE);
+}
+
+//
+// take len bytes from the file contents at *p, which end at end
+//
+static const char *take(const char *path, const char **p, const char *end, size_t len)
+{
+  const char *q = *p;
+
+  if ((size_t)(end - q) < len) fail(path, "truncated heap snapshot");
+  *p += len;
+
+  return q;
+}
+
+static void load(const char *path, snapshot *s)
+{
+  struct stat st;
+  const char *data, *p, *end;
+  uint32_t i, k;
+  uint16_t len;
+  size_t n;
+  heap_stack rec;
+  char *site;
+  int fd;
+
+  if (((fd = open(path, O_RDONLY)) < 0) || (fstat(fd, &st) < 0)) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  if (st.st_size < (off_t)sizeof(heap_header)) fail(path, "not a heap snapshot");
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  p = data;
+  end = data + st.st_size;
+
+  s->path = path;
+  memcpy(&s->hdr, take(path, &p, end, sizeof(heap_header)), sizeof(heap_header));
+  if (memcmp(s->hdr.magic, HEAP_MAGIC, sizeof(s->hdr.magic)) != 0) {
+    fail(path, "not a heap snapshot");
+  }
+  if (s->hdr.version != HEAP_VERSION) fail(path, "unsupported heap snapshot version");
+
+  s->ids = malloc((s->hdr.n_stacks + 1) * sizeof(uint32_t));
+  s->sites = malloc((s->hdr.n_stacks + 1) * sizeof(char*));
+  if ((s->ids == NULL) || (s->sites == NULL)) fail(path, "out of memory");
+
+  for (i = 0; i < s->hdr.n_stacks; i++) {
+    memcpy(&rec, take(path, &p, end, sizeof(rec)), sizeof(rec));
+
+    // the frames, each on a line of its own
+    site = NULL;
+    n = 0;
+    for (k = 0; k < rec.depth; k++) {
+      memcpy(&len, take(path, &p, end, sizeof(len)), sizeof(len));
+      if ((site = realloc(site, n + len + 2)) == NULL) fail(path, "out of memory");
+      memcpy(site + n, take(path, &p, end, len), len);
+      n += len;
+      site[n++] = '\n';
+      site[n] = '\0';
+    }
+    if (site != NULL) site[n - 1] = '\0';
+    s->ids[i] = rec.id;
+    s->sites[i] = site ? site : "[unknown]";
+  }
+
+  n = s->hdr.n_entries * sizeof(heap_entry);
+  if ((s->entries = malloc(n ? n : 1)) == NULL) fail(path, "out of memory");
+  memcpy(s->entries, take(path, &p, end, n), n);
+  for (i = 0; i < s->hdr.n_entries; i++) {
+    s->blocks += s->entries[i].blocks;
+    s->bytes += s->entries[i].bytes;
+  }
+
+  munmap((void*)data, st.st_size);
+}
+
+//
+// the site of a stack of a snapshot
+//
+static const char *site_of(snapshot *s, uint32_t id)
+{
+  uint32_t lo = 0, hi = s->hdr.n_stacks, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (s->ids[mid] == id) return s->sites[mid];
+    if (s->ids[mid] < id) lo = mid + 1;
+    else hi = mid;
+  }
+  fail(s->path, "entry of an unknown stack");
+
+  return NULL;
+}
+
+static int by_site(const void *a, const void *b)
+{
+  const row *x = a, *y = b;
+  int c = strcmp(x->site, y->site);
+
+  return c ? c : (x->size_class > y->size_class) - (x->size_class < y->size_class);
+}
+
+static double growth(const row *r)
+{
+  return r->bytes[1] - r->bytes[0];
+}
+
+static int by_growth(const void *a, const void *b)
+{
+  double x = growth(a), y = growth(b);
+
+  return (x < y) - (x > y);
+}
+
+//
+// fold rows with the same site (and size class, unless all is set), in
+// place; the rows are sorted by site and size class
+//
+static size_t fold(row *rows, size_t n, int all)
+{
+  size_t i, m = 0;
+  int w;
+
+  for (i = 0; i < n; i++) {
+    if ((m > 0) && (strcmp(rows[m - 1].site, rows[i].site) == 0) &&
+        (all || (rows[m - 1].size_class == rows[i].size_class))) {
+      for (w = 0; w < 2; w++) {
+        rows[m - 1].blocks[w] += rows[i].blocks[w];
+        rows[m - 1].bytes[w] += rows[i].bytes[w];
+      }
+    }
+    else {
+      rows[m++] = rows[i];
+    }
+  }
+
+  return m;
+}
+
+static void print_snapshot(const char *name, snapshot *s)
+{
+  time_t t = s->hdr.time_ns / 1000000000ULL;
+  char when[64];
+
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+  printf("  %-4s %s: pid %u, snapshot %llu, %s, %.1f s after start\n",
+         name, s->path, s->hdr.pid, (unsigned long long)s->hdr.seq, when,
+         s->hdr.uptime_ns / 1e9);
+  printf("       %.0f live bytes in %.0f blocks, %.0f bytes allocated, %.0f freed%s\n",
+         s->bytes, s->blocks, s->hdr.allocated, s->hdr.freed,
+         s->hdr.sample_interval > 0 ? " (estimated)" : "");
+}
+
+static void print_class(uint32_t b)
+{
+  char range[48];
+
+  if (b == 0) snprintf(range, sizeof(range), "0");
+  else if (b == 64) snprintf(range, sizeof(range), "[2^63, 2^64)");
+  else snprintf(range, sizeof(range), "[%llu, %llu)", 1ULL << (b - 1), 1ULL << b);
+  printf("    %-26s", range);
+}
+
+int main(int argc, char *argv[])
+{
+  snapshot s[2] = { 0 };
+  row *rows, *sites;
+  size_t i, j, first, n, n_sites, grew, top = 10;
+  double secs;
+  int opt, w;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    if (opt != 'n') break;
+    top = strtoul(optarg, NULL, 10);
+  }
+  if ((opt != -1) || (argc - optind != 2)) {
+    fprintf(stderr, "usage: %s [-n <sites>] <old> <new>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  load(argv[optind], &s[0]);
+  load(argv[optind + 1], &s[1]);
+
+  // a row per entry of either snapshot, folded by site and size class
+  n = s[0].hdr.n_entries + s[1].hdr.n_entries;
+  rows = calloc(n + 1, sizeof(row));
+  sites = calloc(n + 1, sizeof(row));
+  if ((rows == NULL) || (sites == NULL)) fail(argv[0], "out of memory");
+  for (w = 0, j = 0; w < 2; w++) {
+    for (i = 0; i < s[w].hdr.n_entries; i++, j++) {
+      rows[j].site = site_of(&s[w], s[w].entries[i].stack);
+      rows[j].size_class = s[w].entries[i].size_class;
+      rows[j].blocks[w] = s[w].entries[i].blocks;
+      rows[j].bytes[w] = s[w].entries[i].bytes;
+    }
+  }
+  qsort(rows, n, sizeof(row), by_site);
+  n = fold(rows, n, 0);
+  memcpy(sites, rows, n * sizeof(row));
+  n_sites = fold(sites, n, 1);
+  qsort(sites, n_sites, sizeof(row), by_growth);
+  for (grew = 0; (grew < n_sites) && (growth(&sites[grew]) > 0); grew++)
+    ;
+
+  // the same run: the time between the snapshots gives a rate
+  secs = (s[0].hdr.pid == s[1].hdr.pid) ? (s[1].hdr.uptime_ns - (double)s[0].hdr.uptime_ns) / 1e9
+                                        : (s[1].hdr.time_ns - (double)s[0].hdr.time_ns) / 1e9;
+
+  printf("Heap growth\n");
+  print_snapshot("old", &s[0]);
+  print_snapshot("new", &s[1]);
+  printf("  live bytes %+.0f, live blocks %+.0f", s[1].bytes - s[0].bytes, s[1].blocks - s[0].blocks);
+  if (secs > 0) printf(" in %.1f s (%+.1f bytes/s)", secs, (s[1].bytes - s[0].bytes) / secs);
+  printf("\n\n");
+
+  if (grew == 0) {
+    printf("No call site grew.\n");
+    return EXIT_SUCCESS;
+  }
+  if ((top == 0) || (top > grew)) top = grew;
+  printf("Call sites by growth in live bytes (%zu of %zu that grew)\n", top, grew);
+  for (i = 0; i < top; i++) {
+    row *r = &sites[i];
+    const char *f, *nl;
+
+    printf("\n  #%-3zu %+.0f bytes, %+.0f blocks (%.0f -> %.0f bytes)", i + 1, growth(r),
+           r->blocks[1] - r->blocks[0], r->bytes[0], r->bytes[1]);
+    if (secs > 0) printf(", %+.1f bytes/s", growth(r) / secs);
+    printf("\n    %-26s%14s %14s %14s %14s\n", "size class", "+bytes", "+blocks",
+           "old bytes", "new bytes");
+
+    // the size classes of the site that changed, most growth first
+    for (first = 0; (first < n) && (strcmp(rows[first].site, r->site) != 0); first++)
+      ;
+    for (j = first; (j < n) && (strcmp(rows[j].site, r->site) == 0); j++)
+      ;
+    qsort(rows + first, j - first, sizeof(row), by_growth);
+    for (; first < j; first++) {
+      row *c = &rows[first];
+
+      if ((c->bytes[0] == c->bytes[1]) && (c->blocks[0] == c->blocks[1])) continue;
+      print_class(c->size_class);
+      printf("%+14.0f %+14.0f %14.0f %14.0f\n", growth(c), c->blocks[1] - c->blocks[0],
+             c->bytes[0], c->bytes[1]);
+    }
+
+    // the call stack, innermost frame first
+    for (f = r->site; f != NULL; f = nl ? nl + 1 : NULL) {
+      nl = strchr(f, '\n');
+      printf("    %s %.*s\n", (f == r->site) ? "at" : "  ", nl ? (int)(nl - f) : (int)strlen(f), f);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+//
+// memsnap
+//
+// fetch a snapshot from a program traced by memtrace with
+// MEMTRACE_SOCKET set, and print it (JSON) to stdout
+//
+//   usage: memsnap <socket>
+//
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[])
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  char buf[65536];
+  ssize_t n;
+  int fd;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <socket>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path '%s' is too long\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  strcpy(addr.sun_path, argv[1]);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((fd < 0) || (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  // the snapshot ends where the connection does
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    if (fwrite(buf, 1, n, stdout) != (size_t)n) {
+      perror("stdout");
+      return EXIT_FAILURE;
+    }
+  }
+  if (n < 0) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  close(fd);
+  return EXIT_SUCCESS;
+}
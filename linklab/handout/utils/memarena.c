@@ -0,0 +1,51 @@
+#include <stdint.h>
+
+#include "memarena.h"
+
+//
+// size of the arena; it lives in .bss, so the pages it does not use
+// cost nothing
+//
+#define ARENA_BYTES  (1 << 20)
+#define ARENA_ALIGN  16
+
+static char arena[ARENA_BYTES] __attribute__((aligned(4096)));
+static size_t used = 0;
+
+//
+// each block is preceded by its size, in the ARENA_ALIGN bytes below it
+//
+void *arena_alloc(size_t size, size_t align)
+{
+  size_t start, block, end;
+
+  if (align < ARENA_ALIGN) align = ARENA_ALIGN;
+
+  start = __atomic_load_n(&used, __ATOMIC_RELAXED);
+  do {
+    block = (start + ARENA_ALIGN + align - 1) & ~(align - 1);
+    if ((block > ARENA_BYTES) || (size > ARENA_BYTES - block)) return NULL;
+    end = block + size;
+  } while (!__atomic_compare_exchange_n(&used, &start, end, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  *(size_t*)(arena + block - ARENA_ALIGN) = size;
+
+  return arena + block;
+}
+
+int in_arena(const void *ptr)
+{
+  return ((uintptr_t)ptr >= (uintptr_t)arena) &&
+         ((uintptr_t)ptr < (uintptr_t)arena + ARENA_BYTES);
+}
+
+size_t arena_size(const void *ptr)
+{
+  return *(const size_t*)((const char*)ptr - ARENA_ALIGN);
+}
+
+size_t arena_used(void)
+{
+  return __atomic_load_n(&used, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,41 @@
+#ifndef __MEMARENA_H__
+#define __MEMARENA_H__
+
+#include <stddef.h>
+
+//
+// bootstrap arena
+//
+// A static buffer handed out with a bump pointer, for the allocations
+// the tracer's wrappers must serve without libc: those made while the
+// tracer resolves libc's functions, and those made on the tracer's own
+// behalf (by dlsym, stdio, pthread_create, ...). Nothing is ever given
+// back: freeing a block of the arena does nothing. The arena is meant
+// to stay small, and once it is used up the tracer falls back to libc.
+// All functions may be called from any thread.
+//
+
+//
+// allocate size bytes aligned to align (a power of 2; at least 16)
+//
+// returns
+//    void*     pointer to zeroed memory, or NULL if the arena is used up
+//
+void *arena_alloc(size_t size, size_t align);
+
+//
+// whether ptr points into the arena
+//
+int in_arena(const void *ptr);
+
+//
+// size of a block of the arena, as requested from arena_alloc
+//
+size_t arena_size(const void *ptr);
+
+//
+// number of bytes of the arena used so far
+//
+size_t arena_used(void);
+
+#endif
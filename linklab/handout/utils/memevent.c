@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memevent.h"
+
+//
+// events per thread ring (a power of 2), bytes the log file grows by,
+// and how long the flusher sleeps between two passes over the rings
+//
+#define RING_EVENTS  4096
+#define FILE_CHUNK   (4 << 20)
+#define FLUSH_NS     1000000
+
+//
+// a thread's ring: the thread alone moves head, and only whoever holds
+// flush_lock moves tail, so neither side needs a lock to use it; when
+// the thread exits the ring is marked free, and once drained it is
+// handed to the next new thread
+//
+typedef struct __ring {
+  mevent ev[RING_EVENTS];
+  uint64_t head __attribute__((aligned(64)));   // next event written
+  uint64_t tail __attribute__((aligned(64)));   // next event flushed
+  uint32_t tid;
+  int free;                                     // owner thread has exited
+  struct __ring *next;                          // all rings, newest first
+} ring;
+
+enum { UNKNOWN, OPENING, TEXT, BINARY, CLOSED };
+
+static int state = UNKNOWN;
+static uint64_t seq = 0;
+static ring *rings = NULL;
+static ring *late = NULL;                       // events of exiting threads
+
+//
+// the log file and the mapped chunk of it being filled
+//
+static int fd = -1;
+static char *chunk = NULL;
+static size_t chunk_off = 0, chunk_used = 0;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static pthread_t flusher;
+static int flusher_started = 0;
+static volatile int stopping = 0;
+
+//
+// initial-exec TLS lives in the static TLS block, so using it never
+// allocates (the general model may call malloc on first use)
+//
+static __thread ring *my_ring __attribute__((tls_model("initial-exec"))) = NULL;
+
+//
+// tid of the thread once its ring is released, 0 before
+//
+static __thread uint32_t exited_tid __attribute__((tls_model("initial-exec"))) = 0;
+
+//
+// set while the tracer itself allocates, whose calls are not logged
+//
+static __thread int quiet __attribute__((tls_model("initial-exec"))) = 0;
+
+static int map_chunk(size_t off)
+{
+  if (ftruncate(fd, off + FILE_CHUNK) < 0) return -1;
+  chunk = mmap(NULL, FILE_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, fd, off);
+  if (chunk == MAP_FAILED) {
+    chunk = NULL;
+    return -1;
+  }
+  chunk_off = off;
+  chunk_used = 0;
+  return 0;
+}
+
+//
+// copy the events of every ring to the file (flush_lock held)
+//
+static void drain(void)
+{
+  ring *r;
+  uint64_t t, h;
+
+  for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+    t = r->tail;
+    h = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    for (; t < h; t++) {
+      if (chunk_used == FILE_CHUNK) {
+        munmap(chunk, FILE_CHUNK);
+        chunk = NULL;
+        if (map_chunk(chunk_off + FILE_CHUNK) < 0) {
+          // out of disk: keep draining so no thread blocks, losing events
+          chunk_used = 0;
+          continue;
+        }
+      }
+      if (chunk != NULL) {
+        memcpy(chunk + chunk_used, &r->ev[t & (RING_EVENTS - 1)], sizeof(mevent));
+        chunk_used += sizeof(mevent);
+      }
+    }
+    __atomic_store_n(&r->tail, t, __ATOMIC_RELEASE);
+  }
+}
+
+static void flush_rings(void)
+{
+  pthread_mutex_lock(&flush_lock);
+  drain();
+  pthread_mutex_unlock(&flush_lock);
+}
+
+static void *flush_loop(void *arg)
+{
+  struct timespec nap = { 0, FLUSH_NS };
+
+  while (!stopping) {
+    flush_rings();
+    nanosleep(&nap, NULL);
+  }
+  return NULL;
+}
+
+//
+// open the log named by MEMTRACE_LOG, if any, and start the flusher;
+// the state is BINARY before the flusher starts, since creating a
+// thread allocates and so comes back here
+//
+static void open_log(void)
+{
+  const char *path = getenv("MEMTRACE_LOG");
+  mevent_header *h;
+
+  if ((path == NULL) || (*path == '\0')) {
+    __atomic_store_n(&state, TEXT, __ATOMIC_RELEASE);
+    return;
+  }
+
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if ((fd < 0) || (map_chunk(0) < 0)) {
+    fprintf(stderr, "Error opening event log '%s', logging text\n", path);
+    if (fd >= 0) close(fd);
+    __atomic_store_n(&state, TEXT, __ATOMIC_RELEASE);
+    return;
+  }
+
+  h = (mevent_header*)chunk;
+  memcpy(h->magic, MEVENT_MAGIC, sizeof(h->magic));
+  h->version = MEVENT_VERSION;
+  h->event_size = sizeof(mevent);
+  chunk_used = sizeof(mevent_header);
+
+  __atomic_store_n(&state, BINARY, __ATOMIC_RELEASE);
+  quiet = 1;
+  flusher_started = pthread_create(&flusher, NULL, flush_loop, NULL) == 0;
+  quiet = 0;
+}
+
+int mevent_enabled(void)
+{
+  int s = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+  int unknown = UNKNOWN;
+
+  if ((s == UNKNOWN) &&
+      __atomic_compare_exchange_n(&state, &unknown, OPENING, 0,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    open_log();
+  }
+  while ((s = __atomic_load_n(&state, __ATOMIC_ACQUIRE)) == OPENING) {
+    sched_yield();
+  }
+
+  // once closed, events are dropped rather than printed as text
+  return s != TEXT;
+}
+
+//
+// TLS destructor: the exiting thread gives up its ring; what it logs
+// afterwards (glibc still frees memory once the destructors have run)
+// goes to the shared late ring
+//
+static void release_ring(void *arg)
+{
+  ring *r = arg;
+
+  exited_tid = r->tid;
+  my_ring = NULL;
+  __atomic_store_n(&r->free, 1, __ATOMIC_RELEASE);
+}
+
+static void make_ring_key(void)
+{
+  pthread_key_create(&ring_key, release_ring);
+}
+
+static ring *map_ring(void)
+{
+  ring *r = mmap(NULL, sizeof(ring), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (r == MAP_FAILED) return NULL;
+  r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+  return r;
+}
+
+//
+// a free ring whose events have all been flushed, claimed for the
+// calling thread, or NULL; free rings not yet drained are flushed
+// here rather than left for the flusher, which may not have run since
+// their thread exited
+//
+static ring *reuse_ring(void)
+{
+  ring *r;
+  int one, pending = 0, pass;
+
+  for (pass = 0; pass < 2; pass++) {
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+      if (!__atomic_load_n(&r->free, __ATOMIC_ACQUIRE)) continue;
+      if (__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) != r->head) {
+        pending = 1;
+        continue;
+      }
+      one = 1;
+      if (__atomic_compare_exchange_n(&r->free, &one, 0, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        return r;
+      }
+    }
+    if (!pending) break;
+    flush_rings();
+  }
+  return NULL;
+}
+
+static ring *new_ring(void)
+{
+  ring *r = reuse_ring();
+
+  if ((r == NULL) && ((r = map_ring()) == NULL)) return NULL;
+  r->tid = (uint32_t)syscall(SYS_gettid);
+
+  quiet = 1;
+  pthread_once(&ring_key_once, make_ring_key);
+  pthread_setspecific(ring_key, r);
+  quiet = 0;
+  return my_ring = r;
+}
+
+static void put(mevent *e, uint32_t tid, uint32_t op, void *ptr, void *res,
+                size_t size, size_t nmemb)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  e->seq = __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED);
+  e->ts = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  e->ptr = (uintptr_t)ptr;
+  e->res = (uintptr_t)res;
+  e->size = size;
+  e->nmemb = nmemb;
+  e->tid = tid;
+  e->op = op;
+}
+
+//
+// log an event of a thread that has given up its ring; the late ring
+// is shared, so it is only used with flush_lock held
+//
+static int log_late(uint32_t op, void *ptr, void *res, size_t size, size_t nmemb)
+{
+  pthread_mutex_lock(&flush_lock);
+  if ((late == NULL) && ((late = map_ring()) == NULL)) {
+    pthread_mutex_unlock(&flush_lock);
+    return 0;
+  }
+  if (late->head - late->tail == RING_EVENTS) drain();
+  put(&late->ev[late->head & (RING_EVENTS - 1)], exited_tid, op, ptr, res, size, nmemb);
+  __atomic_store_n(&late->head, late->head + 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&flush_lock);
+
+  return 0;
+}
+
+int mevent_log(uint32_t op, void *ptr, void *res, size_t size, size_t nmemb)
+{
+  ring *r = my_ring;
+  uint64_t h;
+
+  if (quiet || (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != BINARY)) return 0;
+  if (r == NULL) {
+    if (exited_tid != 0) return log_late(op, ptr, res, size, nmemb);
+    if ((r = new_ring()) == NULL) return 0;
+  }
+
+  // a full ring is drained by its own thread rather than waited on
+  h = r->head;
+  while (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == RING_EVENTS) {
+    flush_rings();
+  }
+
+  put(&r->ev[h & (RING_EVENTS - 1)], r->tid, op, ptr, res, size, nmemb);
+  __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+void mevent_close(void)
+{
+  int binary = BINARY;
+
+  if (!__atomic_compare_exchange_n(&state, &binary, CLOSED, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  stopping = 1;
+  if (flusher_started) pthread_join(flusher, NULL);
+
+  pthread_mutex_lock(&flush_lock);
+  drain();
+  if (chunk != NULL) {
+    munmap(chunk, FILE_CHUNK);
+    if (ftruncate(fd, chunk_off + chunk_used) < 0) {
+      fprintf(stderr, "Error truncating event log\n");
+    }
+  }
+  close(fd);
+  pthread_mutex_unlock(&flush_lock);
+}
@@ -0,0 +1,84 @@
+#ifndef __MEMEVENT_H__
+#define __MEMEVENT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// binary event log
+//
+// When the environment variable MEMTRACE_LOG names a file, the LOG_*
+// macros of memlog.h record fixed-size events instead of printing
+// text. Each thread appends its events to its own lock-free ring
+// buffer, which a later thread reuses once the first has exited; a
+// background thread drains the rings into the file, which it writes
+// through mmap. tools/memdecode turns the file back into the text the
+// tracer would have printed, statistics included.
+//
+// The file is a header followed by events. Events of different
+// threads are not in order in the file; seq gives the order in which
+// they happened.
+//
+
+#define MEVENT_MAGIC    "MEMEVLOG"
+#define MEVENT_VERSION  1
+
+//
+// event kinds (0 marks the unused tail of a file that was not closed)
+//
+enum {
+  EV_NONE = 0,
+  EV_START,                     // tracer started
+  EV_MALLOC,                    // malloc(size) = res
+  EV_CALLOC,                    // calloc(nmemb, size) = res
+  EV_REALLOC,                   // realloc(ptr, size) = res
+  EV_FREE,                      // free(ptr)
+  EV_DOUBLE_FREE,               // the preceding free was a double free
+  EV_ILL_FREE,                  // the preceding free was illegal
+  EV_POSIX_MEMALIGN,            // posix_memalign(&res, nmemb, size)
+  EV_ALIGNED_ALLOC,             // aligned_alloc(nmemb, size) = res
+  EV_MEMALIGN,                  // memalign(nmemb, size) = res
+  EV_VALLOC,                    // valloc(size) = res
+  EV_PVALLOC,                   // pvalloc(size) = res
+  EV_REALLOCARRAY,              // reallocarray(ptr, nmemb, size) = res
+  EV_NEW,                       // operator new(size[, align nmemb]) = res
+  EV_NEW_ARRAY,                 // operator new[](size[, align nmemb]) = res
+  EV_DELETE,                    // operator delete(ptr[, size])
+  EV_DELETE_ARRAY,              // operator delete[](ptr[, size])
+};
+
+typedef struct __mevent_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t event_size;
+  char pad[48];
+} mevent_header;
+
+typedef struct __mevent {
+  uint64_t seq;                 // order of the event among all threads
+  uint64_t ts;                  // CLOCK_MONOTONIC time in ns
+  uint64_t ptr;                 // pointer argument
+  uint64_t res;                 // result pointer
+  uint64_t size;                // size argument
+  uint64_t nmemb;               // number of elements (calloc)
+  uint32_t tid;                 // thread id
+  uint32_t op;                  // EV_*
+  uint64_t pad;
+} mevent;
+
+//
+// whether events are logged in binary, opening the log on first use
+//
+int mevent_enabled(void);
+
+//
+// log an event of the calling thread; returns 0
+//
+int mevent_log(uint32_t op, void *ptr, void *res, size_t size, size_t nmemb);
+
+//
+// write out every event logged so far and close the log
+//
+void mevent_close(void);
+
+#endif
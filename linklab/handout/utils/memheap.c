@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memheap.h"
+#include "memhist.h"
+#include "memstack.h"
+
+//
+// initial number of slots of the table of entries (a power of 2); it
+// doubles once half of them are used
+//
+#define INITIAL_SLOTS 256
+
+//
+// a slot of the table: the entry of a stack and size class, empty while
+// key is 0
+//
+typedef struct __slot {
+  uint64_t key;
+  heap_entry e;
+} slot;
+
+struct __heap {
+  slot *slots;
+  size_t mask;                  // number of slots - 1
+  size_t count;                 // number of entries
+  int failed;                   // the table could not grow
+};
+
+static void *map(size_t bytes)
+{
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return (p == MAP_FAILED) ? NULL : p;
+}
+
+static uint64_t key(unsigned int stack, int size_class)
+{
+  return (((uint64_t)stack << 8) | size_class) + 1;
+}
+
+static slot *lookup(slot *slots, size_t mask, uint64_t k)
+{
+  size_t i = (size_t)((k * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+
+  while ((slots[i].key != 0) && (slots[i].key != k)) i = (i + 1) & mask;
+  return &slots[i];
+}
+
+static int grow(heap *h)
+{
+  size_t i, n = 2 * (h->mask + 1);
+  slot *slots = map(n * sizeof(slot));
+
+  if (slots == NULL) return -1;
+  for (i = 0; i <= h->mask; i++) {
+    if (h->slots[i].key != 0) *lookup(slots, n - 1, h->slots[i].key) = h->slots[i];
+  }
+  munmap(h->slots, (h->mask + 1) * sizeof(slot));
+  h->slots = slots;
+  h->mask = n - 1;
+
+  return 0;
+}
+
+heap *heap_new(void)
+{
+  heap *h = map(sizeof(heap));
+
+  if (h == NULL) return NULL;
+  if ((h->slots = map(INITIAL_SLOTS * sizeof(slot))) == NULL) {
+    munmap(h, sizeof(heap));
+    return NULL;
+  }
+  h->mask = INITIAL_SLOTS - 1;
+
+  return h;
+}
+
+void heap_add(heap *h, unsigned int stack, size_t size, double weight)
+{
+  int size_class = hist_bucket(size);
+  slot *s;
+
+  if ((h == NULL) || h->failed) return;
+  if (((h->count + 1) * 2 > h->mask + 1) && (grow(h) < 0)) {
+    h->failed = 1;
+    return;
+  }
+
+  s = lookup(h->slots, h->mask, key(stack, size_class));
+  if (s->key == 0) {
+    s->key = key(stack, size_class);
+    s->e.stack = stack;
+    s->e.size_class = size_class;
+    h->count++;
+  }
+  s->e.blocks += weight;
+  s->e.bytes += weight * size;
+}
+
+//
+// write the stacks the entries refer to
+//
+static int write_stacks(heap *h, heap_header *hdr, FILE *f)
+{
+  unsigned int id, n = stack_count() + 1;
+  char *used = map(n), name[256];
+  size_t i;
+  int k;
+
+  if (used == NULL) return -1;
+
+  // every entry's stack was interned before it was added
+  for (i = 0; i <= h->mask; i++) {
+    if (h->slots[i].key != 0) used[h->slots[i].e.stack] = 1;
+  }
+  for (id = 0; id < n; id++) hdr->n_stacks += used[id];
+  fwrite(hdr, sizeof(heap_header), 1, f);
+
+  for (id = 0; id < n; id++) {
+    const stack *st = stack_get(id);
+    heap_stack rec = { id, st ? st->depth : 0 };
+
+    if (!used[id]) continue;
+    fwrite(&rec, sizeof(rec), 1, f);
+    for (k = 0; k < (int)rec.depth; k++) {
+      uint16_t len = strlen(stack_symbol(st->frames[k], name, sizeof(name)));
+
+      fwrite(&len, sizeof(len), 1, f);
+      fwrite(name, 1, len, f);
+    }
+  }
+  munmap(used, n);
+
+  return 0;
+}
+
+int heap_write(heap *h, heap_header *hdr, const char *path)
+{
+  char tmp[PATH_MAX];
+  FILE *f;
+  size_t i;
+  int err;
+
+  if ((h == NULL) || h->failed) {
+    errno = ENOMEM;
+    return -1;
+  }
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  if ((f = fopen(tmp, "we")) == NULL) return -1;
+
+  memcpy(hdr->magic, HEAP_MAGIC, sizeof(hdr->magic));
+  hdr->version = HEAP_VERSION;
+  hdr->n_stacks = 0;
+  hdr->n_entries = h->count;
+  if (write_stacks(h, hdr, f) < 0) {
+    fclose(f);
+    unlink(tmp);
+    errno = ENOMEM;
+    return -1;
+  }
+  for (i = 0; i <= h->mask; i++) {
+    if (h->slots[i].key != 0) fwrite(&h->slots[i].e, sizeof(heap_entry), 1, f);
+  }
+
+  err = ferror(f) ? EIO : 0;
+  if ((fclose(f) != 0) && (err == 0)) err = errno;
+  if ((err == 0) && (rename(tmp, path) < 0)) err = errno;
+  if (err != 0) {
+    unlink(tmp);
+    errno = err;
+    return -1;
+  }
+
+  return 0;
+}
+
+void heap_free(heap *h)
+{
+  if (h == NULL) return;
+
+  munmap(h->slots, (h->mask + 1) * sizeof(slot));
+  munmap(h, sizeof(heap));
+}
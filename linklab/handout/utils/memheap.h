@@ -0,0 +1,91 @@
+#ifndef __MEMHEAP_H__
+#define __MEMHEAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// heap snapshot files
+//
+// A heap snapshot sums up the blocks that have not been freed at one
+// moment by call stack and size class (the buckets of memhist.h): for
+// each pair, the number of live blocks and bytes. tools/memdiff
+// compares two snapshots. The file is
+//
+//   heap_header
+//   n_stacks stacks: a heap_stack, then depth frames, each a uint16_t
+//     length followed by that many bytes of its name (stack_symbol)
+//   n_entries heap_entry
+//
+// Frames are stored by name, not address, so snapshots of different
+// runs of a program can be compared. Numbers are in host byte order.
+//
+
+#define HEAP_MAGIC    "MEMHEAP"
+#define HEAP_VERSION  1
+
+typedef struct __heap_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t pid;                 // process the snapshot is of
+  uint64_t seq;                 // number of the snapshot in its run, from 1
+  uint64_t time_ns;             // when it was taken (CLOCK_REALTIME)
+  uint64_t uptime_ns;           // time since the tracer started
+  double sample_interval;       // MEMTRACE_SAMPLE, 0 if all calls are traced
+  double allocated;             // bytes allocated and freed so far
+  double freed;                 //   (estimates in sampling mode)
+  uint32_t n_stacks;
+  uint32_t n_entries;
+} heap_header;
+
+typedef struct __heap_stack {
+  uint32_t id;                  // id of the stack in the snapshot, 0 unknown
+  uint32_t depth;               // number of frames, innermost first
+} heap_stack;
+
+typedef struct __heap_entry {
+  uint32_t stack;               // id of the stack
+  uint32_t size_class;          // hist_bucket() of the sizes
+  double blocks;                // live blocks and bytes (estimates in
+  double bytes;                 //   sampling mode)
+} heap_entry;
+
+//
+// a snapshot being collected, in memory obtained with mmap
+//
+typedef struct __heap heap;
+
+//
+// start an empty snapshot
+//
+heap *heap_new(void);
+
+//
+// add a live block
+//
+//   h          snapshot
+//   stack      id of the stack that allocated it (memstack.h)
+//   size       size of the block
+//   weight     number of blocks it stands for (1 unless sampling)
+//
+void heap_add(heap *h, unsigned int stack, size_t size, double weight);
+
+//
+// write a snapshot to a file, with the given header
+//
+//   h          snapshot
+//   hdr        header; magic, version and the counts are filled in
+//   path       file name; the snapshot is written next to it first and
+//              then renamed, so path never holds a partial snapshot
+//
+// returns
+//    int       0 on success, -1 on error (with errno set)
+//
+int heap_write(heap *h, heap_header *hdr, const char *path);
+
+//
+// free a snapshot
+//
+void heap_free(heap *h);
+
+#endif
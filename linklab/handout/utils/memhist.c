@@ -0,0 +1,69 @@
+#include <stdio.h>
+
+#include "memhist.h"
+#include "memlog.h"
+
+//
+// the lowest value of bucket b and the lowest value of bucket b + 1
+//
+static double low(int b)
+{
+  return (b == 0) ? 0 : (double)(1ULL << (b - 1));
+}
+
+static double high(int b)
+{
+  return (b == 0) ? 1 : 2 * low(b);
+}
+
+int hist_bucket(uint64_t value)
+{
+  return (value == 0) ? 0 : 64 - __builtin_clzll(value);
+}
+
+void hist_add(hist *h, uint64_t value, double n)
+{
+  h->count[hist_bucket(value)] += n;
+  h->n += n;
+  h->sum += (double)value * n;
+}
+
+void hist_merge(hist *to, const hist *from)
+{
+  int b;
+
+  for (b = 0; b < HIST_BUCKETS; b++) to->count[b] += from->count[b];
+  to->n += from->n;
+  to->sum += from->sum;
+}
+
+void hist_log(const char *title, const hist *h, double scale)
+{
+  int b;
+
+  if (h->n == 0) return;
+
+  LOG_HIST_START(title, h->n, h->sum / scale / h->n);
+  for (b = 0; b < HIST_BUCKETS; b++) {
+    if (h->count[b] > 0) {
+      LOG_HIST_BUCKET(low(b) / scale, high(b) / scale, h->count[b],
+                      100.0 * h->count[b] / h->n);
+    }
+  }
+}
+
+void hist_json(FILE *f, const hist *h, double scale)
+{
+  const char *sep = "";
+  int b;
+
+  fprintf(f, "{ \"count\": %.10g, \"sum\": %.10g, \"buckets\": [", h->n, h->sum / scale);
+  for (b = 0; b < HIST_BUCKETS; b++) {
+    if (h->count[b] > 0) {
+      fprintf(f, "%s\n      { \"from\": %.10g, \"to\": %.10g, \"count\": %.10g }",
+              sep, low(b) / scale, high(b) / scale, h->count[b]);
+      sep = ",";
+    }
+  }
+  fprintf(f, "%s] }", *sep ? "\n    " : "");
+}
@@ -0,0 +1,66 @@
+#ifndef __MEMHIST_H__
+#define __MEMHIST_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// log-bucketed histograms
+//
+// Bucket 0 counts the value 0 and bucket b > 0 the values in
+// [2^(b-1), 2^b), so any 64-bit value has a bucket. A histogram is
+// plain counters: the caller keeps one per thread and merges them,
+// or otherwise sees to it that a histogram is not updated concurrently.
+// The counts are doubles, so that a sampled value can be added with its
+// weight, which is seldom a whole number.
+//
+
+#define HIST_BUCKETS 65
+
+//
+//   count      (weighted) number of values per bucket
+//   n          (weighted) number of values
+//   sum        (weighted) sum of the values
+//
+typedef struct __hist {
+  double count[HIST_BUCKETS];
+  double n;
+  double sum;
+} hist;
+
+//
+// the bucket of a value
+//
+int hist_bucket(uint64_t value);
+
+//
+// add n occurrences of value to a histogram; n need not be a whole
+// number
+//
+void hist_add(hist *h, uint64_t value, double n);
+
+//
+// add the counts of from to to
+//
+void hist_merge(hist *to, const hist *from);
+
+//
+// log the non-empty buckets of a histogram with the LOG_HIST_* macros,
+// unless it is empty
+//
+//   title      heading
+//   h          histogram
+//   scale      the values are in units of 1/scale (1 for plain values)
+//
+void hist_log(const char *title, const hist *h, double scale);
+
+//
+// write a histogram as a JSON object
+//
+//   f          stream
+//   h          histogram
+//   scale      as for hist_log
+//
+void hist_json(FILE *f, const hist *h, double scale);
+
+#endif
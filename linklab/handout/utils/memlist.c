@@ -1,135 +1,540 @@
 #define _GNU_SOURCE
 
 #include <assert.h>
-#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "memlist.h"
 
 //
-// function pointers to stdlib's malloc/free implementation
+// table geometry: the number of shards, each an independent table with
+// its own lock, the initial number of slots of a shard, and the load
+// factor, in eighths, above which a shard doubles (all powers of 2)
 //
-static void *(*callocp)(size_t nelem, size_t size) = NULL;
-static void (*freep)(void *ptr) = NULL;
+#define SHARD_BITS    6
+#define SHARDS        (1 << SHARD_BITS)
+#define INITIAL_SLOTS 64
+#define MAX_LOAD      7
 
-item *new_list(void)
-{
-  // since we are tracing memory (de-)allocations we cannot use
-  // calloc/free directly. We need to make sure that we call the
-  // implementations in stdlib in order not to have them caught 
-  // by our own tracer library.
-  char *error;
+//
+// number of times a snapshot tries to copy a shard without its lock
+// before it takes the lock instead
+//
+#define SNAPSHOT_TRIES 8
+
+//
+// a slot of the table: an item, empty while its ptr is NULL, and how
+// far it sits from its home slot
+//
+typedef struct __slot {
+  item it;
+  size_t dist;
+} slot;
 
-  dlerror();
+//
+// a shard, changed only under its lock. seq is odd while the shard is
+// being changed and advances with every change, so a reader that saw
+// the same even seq before and after copying the slots knows the copy
+// is whole. A reader may still be copying the slots a shard has grown
+// out of: they are unmapped only when no snapshot runs, and otherwise
+// chained on retired until a later change finds none running.
+//
+typedef struct __shard {
+  pthread_mutex_t lock;
+  slot *slots;
+  size_t mask;                  // number of slots - 1
+  size_t count;                 // number of items
+  unsigned long seq;
+  struct __retired *retired;
+} __attribute__((aligned(64))) shard;
+
+//
+// the head of a retired slot array, written over its first slots
+//
+typedef struct __retired {
+  struct __retired *next;
+  size_t bytes;
+} retired;
 
-  callocp = dlsym(RTLD_NEXT, "calloc");
-  if (((error = dlerror()) != NULL) || (callocp == NULL)) {
-    fprintf(stderr, "Error getting symbol 'calloc': %s\n", error);
+struct __memlist {
+  shard shards[SHARDS];
+  int readers;                  // number of snapshots running
+};
+
+//
+// the copy of an item the functions below return; another thread may
+// move or change the item itself as soon as its shard is unlocked
+//
+static __thread item result __attribute__((tls_model("initial-exec")));
+
+//
+// since we are tracing memory (de-)allocations we cannot use calloc/free
+// for the table; mmap hands out zeroed pages without going through the
+// allocator at all
+//
+static void *map(size_t bytes)
+{
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "Error mapping %zu bytes for the block table\n", bytes);
     exit(EXIT_FAILURE);
   }
+  return p;
+}
 
-  freep = dlsym(RTLD_NEXT, "free");
-  if (((error = dlerror()) != NULL) || (freep == NULL)) {
-    fprintf(stderr, "Error getting symbol 'free': %s\n", error);
-    exit(EXIT_FAILURE);
+static uint64_t hash(void *ptr)
+{
+  // blocks are at least 16-byte aligned: drop the low bits, then mix
+  return ((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ULL;
+}
+
+//
+// the shard of ptr, from the top bits of its hash, locked
+//
+static shard *lock_shard(memlist *list, void *ptr)
+{
+  shard *sh = &list->shards[hash(ptr) >> (64 - SHARD_BITS)];
+
+  pthread_mutex_lock(&sh->lock);
+  return sh;
+}
+
+//
+// open and close a change of a shard, which is locked
+//
+static void change(shard *sh)
+{
+  __atomic_store_n(&sh->seq, sh->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void changed(shard *sh)
+{
+  __atomic_store_n(&sh->seq, sh->seq + 1, __ATOMIC_RELEASE);
+}
+
+static size_t home(shard *sh, void *ptr)
+{
+  return (size_t)(hash(ptr) >> 20) & sh->mask;
+}
+
+static item *copy(shard *sh, item *it)
+{
+  if (it != NULL) {
+    result = *it;
+    it = &result;
   }
+  pthread_mutex_unlock(&sh->lock);
+  return it;
+}
+
+//
+// place an item that is not in the table yet, returning its slot
+//
+static slot *place(shard *sh, item it)
+{
+  slot s = { it, 0 }, tmp, *landed = NULL;
+  size_t i = home(sh, it.ptr);
 
-  // create new list
-  return (item*)callocp(1, sizeof(item));
+  while (sh->slots[i].it.ptr != NULL) {
+    if (sh->slots[i].dist < s.dist) {
+      // the resident is closer to home: it moves on instead
+      tmp = sh->slots[i];
+      sh->slots[i] = s;
+      s = tmp;
+      if (landed == NULL) landed = &sh->slots[i];
+    }
+    i = (i + 1) & sh->mask;
+    s.dist++;
+  }
+  sh->slots[i] = s;
+  sh->count++;
+
+  return landed ? landed : &sh->slots[i];
 }
 
-void free_list(item *list)
+//
+// unmap the slots a shard has grown out of, or keep them while a
+// snapshot may be copying them
+//
+static void retire(memlist *list, shard *sh, slot *old, size_t bytes)
 {
-  item *next;
+  retired *r = (retired*)old;
 
-  while (list) {
-    next = list->next;
-    freep(list);
-    list = next;
+  // the new slots are published before readers is read, and a snapshot
+  // counts itself before it reads the slots: if it got the old ones,
+  // readers is not 0 here
+  if (__atomic_load_n(&list->readers, __ATOMIC_SEQ_CST) != 0) {
+    r->next = sh->retired;
+    r->bytes = bytes;
+    sh->retired = r;
+    return;
+  }
+
+  munmap(old, bytes);
+  while ((r = sh->retired) != NULL) {
+    sh->retired = r->next;
+    munmap(r, r->bytes);
   }
 }
 
-item *alloc(item *list, void *ptr, size_t size)
+static void grow(memlist *list, shard *sh)
 {
-  item *prev, *cur, *i;
-  int res;
+  slot *old = sh->slots;
+  size_t i, n = sh->mask + 1;
 
-  if (list == NULL) return NULL;
+  // the slots before the mask: a reader that sees the new mask also
+  // sees the new, larger slots
+  __atomic_store_n(&sh->slots, map(2 * n * sizeof(slot)), __ATOMIC_SEQ_CST);
+  __atomic_store_n(&sh->mask, 2 * n - 1, __ATOMIC_RELEASE);
+  sh->count = 0;
+  for (i = 0; i < n; i++) {
+    if (old[i].it.ptr != NULL) place(sh, old[i].it);
+  }
+  retire(list, sh, old, n * sizeof(slot));
+}
 
-  i = (item*)callocp(1, sizeof(item));
-  i->ptr = ptr;
-  i->size = size;
-  i->cnt = 1;
+static slot *lookup(shard *sh, void *ptr)
+{
+  size_t i, dist;
 
-  // check if block already exists
-  prev = list; cur = list->next;
-  while ((cur != NULL) && (cur->ptr < i->ptr)) {
-    prev = cur; cur = cur->next;
-  }
-
-  if (cur == NULL) {
-    // new block -> insert into list
-    prev->next = i;
-  } else {
-    if (cur->ptr == i->ptr) {
-      // existing block -> update size & reference counter
-      cur->size = i->size;
-      cur->cnt++;
-      freep(i);
-      i = cur;
-    } else {
-      // new block -> insert into list
-      i->next = cur;
-      prev->next = i;
+  if (ptr == NULL) return NULL;
+
+  // an entry further from home than ptr would be means ptr is absent
+  i = home(sh, ptr);
+  for (dist = 0; sh->slots[i].it.ptr != NULL && sh->slots[i].dist >= dist; dist++) {
+    if (sh->slots[i].it.ptr == ptr) return &sh->slots[i];
+    i = (i + 1) & sh->mask;
+  }
+
+  return NULL;
+}
+
+memlist *new_list(void)
+{
+  memlist *list = map(sizeof(memlist));
+  int i;
+
+  for (i = 0; i < SHARDS; i++) {
+    pthread_mutex_init(&list->shards[i].lock, NULL);
+    list->shards[i].slots = map(INITIAL_SLOTS * sizeof(slot));
+    list->shards[i].mask = INITIAL_SLOTS - 1;
+    list->shards[i].count = 0;
+  }
+
+  return list;
+}
+
+void free_list(memlist *list)
+{
+  int i;
+
+  if (list == NULL) return;
+
+  for (i = 0; i < SHARDS; i++) {
+    retired *r;
+
+    munmap(list->shards[i].slots, (list->shards[i].mask + 1) * sizeof(slot));
+    while ((r = list->shards[i].retired) != NULL) {
+      list->shards[i].retired = r->next;
+      munmap(r, r->bytes);
     }
   }
+  munmap(list, sizeof(memlist));
+}
+
+item *alloc(memlist *list, void *ptr, size_t size)
+{
+  item it = { ptr, size };
 
-  return i;
+  return alloc_item(list, &it);
 }
 
-item *dealloc(item *list, void *ptr)
+item *alloc_item(memlist *list, const item *new_item)
 {
-  item *prev, *cur, *i;
+  shard *sh;
+  slot *s;
+  item it = *new_item;
 
   if (list == NULL) return NULL;
+  sh = lock_shard(list, it.ptr);
+  change(sh);
 
-  // find block
-  prev = list; cur = list->next;
-  while ((cur != NULL) && (cur->ptr != ptr)) {
-    prev = cur; cur = cur->next;
+  // check if block already exists
+  s = lookup(sh, it.ptr);
+  if (s != NULL) {
+    // existing block -> update size & reference counter
+    it.cnt = s->it.cnt + 1;
+    s->it = it;
+  }
+  else {
+    // new block -> insert into table
+    it.cnt = 1;
+    if ((sh->count + 1) * 8 > (sh->mask + 1) * MAX_LOAD) grow(list, sh);
+    s = place(sh, it);
   }
+  changed(sh);
+
+  return copy(sh, &s->it);
+}
+
+item *dealloc(memlist *list, void *ptr)
+{
+  shard *sh;
+  slot *s;
+
+  if (list == NULL) return NULL;
+  sh = lock_shard(list, ptr);
 
   // decrement reference count if found
-  if (cur != NULL) cur->cnt--;
+  s = lookup(sh, ptr);
+  if (s != NULL) {
+    change(sh);
+    s->it.cnt--;
+    changed(sh);
+  }
 
-  return cur;
+  return copy(sh, s ? &s->it : NULL);
 }
 
-item *find(item *list, void *ptr)
+item *release(memlist *list, void *ptr)
 {
+  shard *sh;
+  slot *s;
+
   if (list == NULL) return NULL;
+  sh = lock_shard(list, ptr);
+
+  s = lookup(sh, ptr);
+  if (s == NULL) return copy(sh, NULL);
+
+  result = s->it;
+  if (s->it.cnt > 0) {
+    change(sh);
+    s->it.cnt--;
+    changed(sh);
+  }
+  pthread_mutex_unlock(&sh->lock);
+
+  return &result;
+}
+
+item *find(memlist *list, void *ptr)
+{
+  shard *sh;
+  slot *s;
+
+  if (list == NULL) return NULL;
+  sh = lock_shard(list, ptr);
+  s = lookup(sh, ptr);
+
+  return copy(sh, s ? &s->it : NULL);
+}
+
+int forget(memlist *list, void *ptr)
+{
+  shard *sh;
+  slot *s;
+  size_t i, j;
+
+  if (list == NULL) return 0;
+  sh = lock_shard(list, ptr);
+
+  s = lookup(sh, ptr);
+  if (s == NULL) {
+    pthread_mutex_unlock(&sh->lock);
+    return 0;
+  }
+
+  // shift the entries that follow back by one until one is at home
+  change(sh);
+  i = s - sh->slots;
+  j = (i + 1) & sh->mask;
+  while (sh->slots[j].it.ptr != NULL && sh->slots[j].dist > 0) {
+    sh->slots[i] = sh->slots[j];
+    sh->slots[i].dist--;
+    i = j;
+    j = (j + 1) & sh->mask;
+  }
+  memset(&sh->slots[i], 0, sizeof(slot));
+  sh->count--;
+  changed(sh);
+  pthread_mutex_unlock(&sh->lock);
+
+  return 1;
+}
+
+//
+// heap sort of the items by address; qsort may allocate, which would
+// come back into the tracer
+//
+static void sift(item *a, size_t root, size_t n)
+{
+  size_t child;
+  item tmp;
+
+  while ((child = 2 * root + 1) < n) {
+    if ((child + 1 < n) && (a[child].ptr < a[child + 1].ptr)) child++;
+    if (a[root].ptr >= a[child].ptr) return;
+    tmp = a[root]; a[root] = a[child]; a[child] = tmp;
+    root = child;
+  }
+}
+
+static void sort_items(item *a, size_t n)
+{
+  size_t i;
+  item tmp;
+
+  for (i = n / 2; i > 0; i--) sift(a, i - 1, n);
+  for (i = n; i > 1; i--) {
+    tmp = a[0]; a[0] = a[i - 1]; a[i - 1] = tmp;
+    sift(a, 0, i - 1);
+  }
+}
+
+void walk_list(memlist *list, void (*visit)(item *i, void *arg), void *arg)
+{
+  item *items = NULL;
+  size_t i, n = 0, count = 0, bytes = 0;
+  int k;
+
+  if (list == NULL) return;
+
+  // copy every shard at one instant, then visit the sorted copy without
+  // holding the locks, so that visit may allocate or free
+  for (k = 0; k < SHARDS; k++) {
+    pthread_mutex_lock(&list->shards[k].lock);
+    count += list->shards[k].count;
+  }
+  if (count > 0) {
+    bytes = count * sizeof(item);
+    items = map(bytes);
+    for (k = 0; k < SHARDS; k++) {
+      shard *sh = &list->shards[k];
 
-  list = list->next;
-  while ((list != NULL) && (ptr > list->ptr)) {
-    list = list->next;
+      for (i = 0; i <= sh->mask; i++) {
+        if (sh->slots[i].it.ptr != NULL) items[n++] = sh->slots[i].it;
+      }
+    }
+  }
+  for (k = SHARDS - 1; k >= 0; k--) {
+    pthread_mutex_unlock(&list->shards[k].lock);
   }
+  if (items == NULL) return;
 
-  if ((list != NULL) && (list->ptr == ptr)) return list;
-  else return NULL;
+  sort_items(items, n);
+  for (i = 0; i < n; i++) visit(&items[i], arg);
+
+  munmap(items, bytes);
 }
 
-void dump_list(item *list)
+//
+// make room for n elements of size bytes in an mmap'd array of *cap
+//
+static void *reserve(void *a, size_t *cap, size_t n, size_t size)
+{
+  size_t want = *cap ? *cap : 1024;
+
+  if (n <= *cap) return a;
+  while (want < n) want *= 2;
+  if (a == NULL) a = map(want * size);
+  else a = mremap(a, *cap * size, want * size, MREMAP_MAYMOVE);
+  if (a == MAP_FAILED) {
+    fprintf(stderr, "Error mapping %zu bytes for a snapshot\n", want * size);
+    exit(EXIT_FAILURE);
+  }
+  *cap = want;
+
+  return a;
+}
+
+//
+// the snapshot of a list: copies of its items, and of the slots of the
+// shard being copied
+//
+typedef struct __snapshot {
+  item *items;
+  size_t n, cap;
+  slot *slots;
+  size_t n_slots;
+} snapshot;
+
+//
+// copy the slots of a shard into the snapshot; returns the number of
+// slots copied, or 0 if the shard changed meanwhile
+//
+static size_t copy_slots(shard *sh, snapshot *snap, int locked)
+{
+  unsigned long seq = __atomic_load_n(&sh->seq, __ATOMIC_ACQUIRE);
+  size_t n = __atomic_load_n(&sh->mask, __ATOMIC_ACQUIRE) + 1;
+  slot *slots = __atomic_load_n(&sh->slots, __ATOMIC_SEQ_CST);
+
+  if (seq & 1) return 0;
+  snap->slots = reserve(snap->slots, &snap->n_slots, n, sizeof(slot));
+  memcpy(snap->slots, slots, n * sizeof(slot));
+  if (locked) return n;
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return (__atomic_load_n(&sh->seq, __ATOMIC_RELAXED) == seq) ? n : 0;
+}
+
+void walk_snapshot(memlist *list, void (*visit)(item *i, void *arg), void *arg)
+{
+  snapshot snap = { 0 };
+  size_t i, n;
+  int k, tries;
+
+  if (list == NULL) return;
+
+  // copy the shards one by one while no thread changes them, holding a
+  // shard's lock only if it keeps changing
+  __atomic_fetch_add(&list->readers, 1, __ATOMIC_SEQ_CST);
+  for (k = 0; k < SHARDS; k++) {
+    shard *sh = &list->shards[k];
+
+    for (tries = 0, n = 0; (n == 0) && (tries < SNAPSHOT_TRIES); tries++) {
+      n = copy_slots(sh, &snap, 0);
+    }
+    if (n == 0) {
+      pthread_mutex_lock(&sh->lock);
+      n = copy_slots(sh, &snap, 1);
+      pthread_mutex_unlock(&sh->lock);
+    }
+
+    snap.items = reserve(snap.items, &snap.cap, snap.n + n, sizeof(item));
+    for (i = 0; i < n; i++) {
+      if (snap.slots[i].it.ptr != NULL) snap.items[snap.n++] = snap.slots[i].it;
+    }
+  }
+  __atomic_fetch_sub(&list->readers, 1, __ATOMIC_SEQ_CST);
+
+  if (snap.slots != NULL) munmap(snap.slots, snap.n_slots * sizeof(slot));
+  if (snap.items == NULL) return;
+
+  sort_items(snap.items, snap.n);
+  for (i = 0; i < snap.n; i++) visit(&snap.items[i], arg);
+
+  munmap(snap.items, snap.cap * sizeof(item));
+}
+
+static void print_item(item *i, void *arg)
+{
+  printf("  %-16p   %-8zd   %-3d\n",
+      i->ptr, i->size, i->cnt);
+}
+
+void dump_list(memlist *list)
 {
   assert(list != NULL);
-  item *i = list->next;
 
   printf("  %-16s   %-8s   %-3s\n",
       "block", "size", "cnt");
-  while (i != NULL) {
-    printf("  %-16p   %-8zd   %-3d\n",
-        i->ptr, i->size, i->cnt);
-    i = i->next;
-  }
+  walk_list(list, print_item, NULL);
 }
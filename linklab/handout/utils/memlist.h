@@ -2,40 +2,61 @@
 #define __MEMLIST_H__
 
 #include <stddef.h>
+#include <stdint.h>
 
 //
-// list element holding information about an allocated memory block
+// element holding information about an allocated memory block
 //
 //   ptr        pointer to block
 //   size       size of block
 //   cnt        allocate count
-//
-//   next       pointer to next item in linked list
+//   stack      id of the call stack that allocated the block (memstack.h),
+//              0 if unknown
+//   op         number of calls traced before the block was allocated
+//   ns         time the block was allocated (CLOCK_MONOTONIC, in ns)
 //
 typedef struct __item {
   void *ptr;
   size_t size;
   int cnt;
-  struct __item *next;
+  unsigned int stack;
+  uint64_t op;
+  uint64_t ns;
 } item;
 
+//
+// table of the blocks, keyed on their pointer
+//
+// An open-addressing hash table with Robin Hood probing: an entry that
+// has moved further from its home slot takes the place of one that has
+// moved less, which keeps every probe sequence short, and deletion
+// shifts the following entries back instead of leaving tombstones.
+// The table lives in memory obtained with mmap, so keeping track of
+// the blocks never calls the allocator being traced.
+//
+// The table is split into shards by pointer, each with its own lock,
+// and all functions may be called from any thread. The item pointers
+// they return point to a copy private to the calling thread, which
+// its next call overwrites; changing it does not change the table.
+//
+typedef struct __memlist memlist;
+
 
 //
-// initialize a new list.
-// The first element is a dummy element
+// initialize a new, empty table
 //
-item *new_list(void);
+memlist *new_list(void);
 
 //
-// free a list
+// free a table
 //
-void free_list(item *list);
+void free_list(memlist *list);
 
 //
-// add information about newly allocated block to list
+// add information about newly allocated block to table
 //
 //
-//   list       pointer to list
+//   list       pointer to table
 //   ptr        pointer to newly allocated block
 //   size       size of newly allocated block
 //
@@ -45,37 +66,94 @@ void free_list(item *list);
 // the reference count is updated automatically. If the block is re-allocated
 // (i.e., there already is an item to ptr) the size of the item is adjusted.
 //
-item *alloc(item *list, void *ptr, size_t size);
+item *alloc(memlist *list, void *ptr, size_t size);
+
+//
+// same as alloc, for the block described by it: its ptr, size and the
+// fields following cnt are recorded, cnt is ignored
+//
+item *alloc_item(memlist *list, const item *it);
 
 //
 // update information on freed block
 //
-//    list      pointer to list
+//    list      pointer to table
 //    ptr       pointer to freed block
 //
 // returns
 //    item*     pointer to item holding information about freed block
 //
-// the reference count is updated automatically
+// the reference count is updated automatically. The item is kept, so a
+// second free of ptr can be told from a free of an unknown pointer.
+//
+item *dealloc(memlist *list, void *ptr);
+
+//
+// update information on freed block, unless it is freed already
+//
+//    list      pointer to table
+//    ptr       pointer to freed block
+//
+// returns
+//    item*     the item as it was before: a reference count of 0 means
+//              the block was freed already and is left as it is
+//
+// checking and updating the count is one step, so of two threads
+// freeing the same block only one sees it allocated
 //
-item *dealloc(item *list, void *ptr);
+item *release(memlist *list, void *ptr);
 
 //
-// find information about a block in list
+// find information about a block in table
 //
-//   list       pointer to list
+//   list       pointer to table
 //   ptr        pointer of block
 //
 // returns
 //    item*     pointer to item holding information about the block
 //
-item *find(item *list, void *ptr);
+item *find(memlist *list, void *ptr);
+
+//
+// remove the item of a block from table
+//
+//   list       pointer to table
+//   ptr        pointer of block
+//
+// returns
+//    int       1 if there was an item to remove, 0 otherwise
+//
+int forget(memlist *list, void *ptr);
+
+//
+// call visit(item, arg) for every item in table, in address order
+//
+//   list       pointer to table
+//   visit      function to call
+//   arg        passed on to visit
+//
+void walk_list(memlist *list, void (*visit)(item *i, void *arg), void *arg);
+
+//
+// call visit(item, arg) for every item of a snapshot of table, in
+// address order
+//
+//   list       pointer to table
+//   visit      function to call
+//   arg        passed on to visit
+//
+// unlike walk_list, which stops all changes while it copies the table,
+// the snapshot copies the shards one after the other, each between two
+// changes of it, so threads keep allocating and freeing meanwhile. Each
+// shard is copied as it was at one instant, but the instants differ.
+//
+void walk_snapshot(memlist *list, void (*visit)(item *i, void *arg), void *arg);
 
 //
-// dump (print) the list in human-readable form to stdout
+// dump (print) the table in human-readable form to stdout
 //
-//   list       pointer to list
+//   list       pointer to table
 //
-void dump_list(item *list);
+void dump_list(memlist *list);
 
 #endif
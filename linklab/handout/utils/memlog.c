@@ -1,19 +1,27 @@
+#define _GNU_SOURCE
+
 #include <stdarg.h>
 #include <stdio.h>
 
+FILE *mlog_file = NULL;
+
 int mlog(const char *fmt, ...)
 {
   static unsigned int id = 1;
+  FILE *f = mlog_file ? mlog_file : stderr;
   va_list ap;
   int res;
 
-  res = fprintf(stderr, "[%04u] ", id++);
+  // one line at a time, numbered in the order the lines appear
+  flockfile(f);
+  res = fprintf(f, "[%04u] ", id++);
 
   va_start(ap, fmt);
-  res += vfprintf(stderr, fmt, ap);
+  res += vfprintf(f, fmt, ap);
   va_end(ap);
 
-  fprintf(stderr, "\n");
+  fprintf(f, "\n");
+  funlockfile(f);
 
   return res;
 }
@@ -3,9 +3,11 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include "memevent.h"
 
 //
-// log a call to one of the dynamic memory management functions to stderr
+// log a call to one of the dynamic memory management functions to stderr,
+// or as a binary event if MEMTRACE_LOG is set (see memevent.h)
 //
 //   res        result pointer (if any)
 //
@@ -16,48 +18,158 @@
 // returns the number of characters printed
 //
 
-#define LOG_MALLOC(size, res)         mlog("%9c malloc( %zu ) = %p", ' ', size, res)
-#define LOG_CALLOC(nmemb, size, res)  mlog("%9c calloc( %zu , %zu ) = %p", ' ', nmemb, size, res)
-#define LOG_REALLOC(ptr, size, res)   mlog("%9c realloc( %p , %zu ) = %p", ' ', ptr, size, res)
-#define LOG_FREE(ptr)                 mlog("%9c free( %p )", ' ', ptr)
+#define LOG_MALLOC(size, res) \
+  (mevent_enabled() ? mevent_log(EV_MALLOC, NULL, res, size, 0) \
+                    : mlog("%9c malloc( %zu ) = %p", ' ', size, res))
+#define LOG_CALLOC(nmemb, size, res) \
+  (mevent_enabled() ? mevent_log(EV_CALLOC, NULL, res, size, nmemb) \
+                    : mlog("%9c calloc( %zu , %zu ) = %p", ' ', nmemb, size, res))
+#define LOG_REALLOC(ptr, size, res) \
+  (mevent_enabled() ? mevent_log(EV_REALLOC, ptr, res, size, 0) \
+                    : mlog("%9c realloc( %p , %zu ) = %p", ' ', ptr, size, res))
+#define LOG_FREE(ptr) \
+  (mevent_enabled() ? mevent_log(EV_FREE, ptr, NULL, 0, 0) \
+                    : mlog("%9c free( %p )", ' ', ptr))
+#define LOG_POSIX_MEMALIGN(align, size, res) \
+  (mevent_enabled() ? mevent_log(EV_POSIX_MEMALIGN, NULL, res, size, align) \
+                    : mlog("%9c posix_memalign( %zu , %zu ) = %p", ' ', align, size, res))
+#define LOG_ALIGNED_ALLOC(align, size, res) \
+  (mevent_enabled() ? mevent_log(EV_ALIGNED_ALLOC, NULL, res, size, align) \
+                    : mlog("%9c aligned_alloc( %zu , %zu ) = %p", ' ', align, size, res))
+#define LOG_MEMALIGN(align, size, res) \
+  (mevent_enabled() ? mevent_log(EV_MEMALIGN, NULL, res, size, align) \
+                    : mlog("%9c memalign( %zu , %zu ) = %p", ' ', align, size, res))
+#define LOG_VALLOC(size, res) \
+  (mevent_enabled() ? mevent_log(EV_VALLOC, NULL, res, size, 0) \
+                    : mlog("%9c valloc( %zu ) = %p", ' ', size, res))
+#define LOG_PVALLOC(size, res) \
+  (mevent_enabled() ? mevent_log(EV_PVALLOC, NULL, res, size, 0) \
+                    : mlog("%9c pvalloc( %zu ) = %p", ' ', size, res))
+#define LOG_REALLOCARRAY(ptr, nmemb, size, res) \
+  (mevent_enabled() ? mevent_log(EV_REALLOCARRAY, ptr, res, size, nmemb) \
+                    : mlog("%9c reallocarray( %p , %zu , %zu ) = %p", ' ', ptr, nmemb, size, res))
+
+//
+// log a call to C++'s operator new or delete; align and size are 0
+// unless the operator takes them
+//
+#define LOG_NEW(size, align, res) \
+  (mevent_enabled() ? mevent_log(EV_NEW, NULL, res, size, align) \
+                    : mlog(align ? "%9c operator new( %zu , align %zu ) = %p" \
+                                 : "%9c operator new( %zu%.0zu ) = %p", ' ', size, align, res))
+#define LOG_NEW_ARRAY(size, align, res) \
+  (mevent_enabled() ? mevent_log(EV_NEW_ARRAY, NULL, res, size, align) \
+                    : mlog(align ? "%9c operator new[]( %zu , align %zu ) = %p" \
+                                 : "%9c operator new[]( %zu%.0zu ) = %p", ' ', size, align, res))
+#define LOG_DELETE(ptr, size) \
+  (mevent_enabled() ? mevent_log(EV_DELETE, ptr, NULL, size, 0) \
+                    : mlog(size ? "%9c operator delete( %p , %zu )" \
+                                : "%9c operator delete( %p%.0zu )", ' ', ptr, size))
+#define LOG_DELETE_ARRAY(ptr, size) \
+  (mevent_enabled() ? mevent_log(EV_DELETE_ARRAY, ptr, NULL, size, 0) \
+                    : mlog(size ? "%9c operator delete[]( %p , %zu )" \
+                                : "%9c operator delete[]( %p%.0zu )", ' ', ptr, size))
 
 
 //
-// log statistics
+// log statistics (in binary mode the decoder computes them from the events)
 //
 #define LOG_STATISTICS(alloc_total, alloc_avg, free_total) \
-  { mlog(""); \
+  if (!mevent_enabled()) { \
+    mlog(""); \
     mlog("Statistics"); \
     mlog("  allocated_total      %lu", alloc_total); \
     mlog("  allocated_avg        %lu", alloc_avg); \
     mlog("  freed_total          %lu", free_total); \
   }
 
+//
+// log a histogram (see memhist.h) and its non-empty buckets
+//
+#define LOG_HIST_START(title, n, mean) \
+  if (!mevent_enabled()) { \
+    mlog(""); \
+    mlog("%s: %.0f, mean %.1f", title, n, mean); \
+    mlog("  %-12s   %-12s   %-10s   %-6s", "from", "to", "count", "%"); \
+  }
+#define LOG_HIST_BUCKET(from, to, count, pct) \
+  (mevent_enabled() ? 0 : mlog("  %-12.10g   %-12.10g   %-10.0f   %-6.2f", \
+                               from, to, count, pct))
+
+//
+// log the estimates of sampling mode (see part3/memtrace.c)
+//
+#define LOG_SAMPLING(mean, samples, alloc_total, alloc_est, free_est, live_est, \
+                     live_blocks, rate_est) \
+  if (!mevent_enabled()) { \
+    mlog(""); \
+    mlog("Sampling (mean interval %.0f bytes)", mean); \
+    mlog("  samples              %lu", samples); \
+    mlog("  allocated_total      %lu", alloc_total); \
+    mlog("  allocated_estimate   %.0f", alloc_est); \
+    mlog("  freed_estimate       %.0f", free_est); \
+    mlog("  live_estimate        %.0f bytes in %.0f blocks", live_est, live_blocks); \
+    mlog("  alloc_rate_estimate  %.0f bytes/s", rate_est); \
+  }
+
 //
 // log statistics about memory blocks
 //
 #define LOG_NONFREED_START() \
-  { mlog(""); \
+  if (!mevent_enabled()) { \
+    mlog(""); \
     mlog("Non-deallocated memory blocks"); \
     mlog("  %-16s   %-8s   %-7s", "block", "size", "ref cnt"); \
   }
-#define LOG_BLOCK(ptr, size, cnt) mlog("  %-16p   %-8zd   %-7d", ptr, size, cnt)
+#define LOG_BLOCK(ptr, size, cnt) \
+  (mevent_enabled() ? 0 : mlog("  %-16p   %-8zd   %-7d", ptr, size, cnt))
+
+//
+// log the memory blocks that have not been freed per call stack, and
+// the frames of a stack
+//
+#define LOG_STACKS_START() \
+  if (!mevent_enabled()) { \
+    mlog(""); \
+    mlog("Non-deallocated memory by call stack"); \
+    mlog("  %-7s   %-12s   %-8s   %-8s   %-12s", \
+         "stack", "live bytes", "blocks", "allocs", "alloc bytes"); \
+  }
+#define LOG_STACK(id, live, blocks, allocs, bytes) \
+  (mevent_enabled() ? 0 : mlog("  #%-6u   %-12.0f   %-8.0f   %-8lu   %-12lu", \
+                               id, live, blocks, allocs, bytes))
+#define LOG_FRAME(addr, name) \
+  (mevent_enabled() ? 0 : mlog("  %9c %-16p   %s", ' ', addr, name))
 
 //
 // log invalid deallocation requests
 //
-#define LOG_DOUBLE_FREE()             mlog("%2c  *** DOUBLE_FREE  *** (ignoring)", ' ')
-#define LOG_ILL_FREE()                mlog("%2c  *** ILLEGAL_FREE *** (ignoring)", ' ')
+#define LOG_DOUBLE_FREE() \
+  (mevent_enabled() ? mevent_log(EV_DOUBLE_FREE, NULL, NULL, 0, 0) \
+                    : mlog("%2c  *** DOUBLE_FREE  *** (ignoring)", ' '))
+#define LOG_ILL_FREE() \
+  (mevent_enabled() ? mevent_log(EV_ILL_FREE, NULL, NULL, 0, 0) \
+                    : mlog("%2c  *** ILLEGAL_FREE *** (ignoring)", ' '))
 
 //
 // log start/end messages
 //
-#define LOG_START()                   mlog("Memory tracer started.")
+#define LOG_START() \
+  (mevent_enabled() ? mevent_log(EV_START, NULL, NULL, 0, 0) \
+                    : mlog("Memory tracer started."))
 #define LOG_STOP() \
-  { mlog(""); \
+  if (mevent_enabled()) { \
+    mevent_close(); \
+  } else { \
+    mlog(""); \
     mlog("Memory tracer stopped."); \
   }
 
+//
+// stream mlog writes to; stderr if NULL
+//
+extern FILE *mlog_file;
+
 //
 // do not use this directly. Invoke through one of the macros above
 //
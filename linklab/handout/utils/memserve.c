@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memserve.h"
+
+static int listen_fd = -1;
+static struct sockaddr_un addr;
+static void (*report_fn)(int fd);
+static pthread_t server;
+
+//
+// the snapshot thread sleeps on wakeup, which the signal handler posts
+//
+static sem_t wakeup;
+static double trigger_interval;
+static void (*take_fn)(void);
+static pthread_t trigger;
+static volatile int stopping = 0;
+
+static void block_signals(void)
+{
+  sigset_t all;
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, NULL);
+}
+
+static void *serve_loop(void *arg)
+{
+  int fd;
+
+  block_signals();
+
+  // serve_stop shuts the socket down, which fails accept
+  while (1) {
+    fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if ((errno == EINTR) || (errno == ECONNABORTED)) continue;
+      break;
+    }
+    report_fn(fd);
+    close(fd);
+  }
+
+  return NULL;
+}
+
+//
+// close the socket after an error, keeping errno
+//
+static int fail(int err)
+{
+  close(listen_fd);
+  listen_fd = -1;
+  errno = err;
+  return -1;
+}
+
+int serve_start(const char *path, void (*report)(int fd))
+{
+  struct stat st;
+  int err;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode)) unlink(path);
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) return -1;
+  if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) return fail(errno);
+  if (listen(listen_fd, 4) < 0) {
+    err = errno;
+    unlink(path);
+    return fail(err);
+  }
+
+  report_fn = report;
+  if ((err = pthread_create(&server, NULL, serve_loop, NULL)) != 0) {
+    unlink(path);
+    return fail(err);
+  }
+  pthread_detach(server);
+
+  return 0;
+}
+
+static void on_signal(int signo)
+{
+  int err = errno;
+
+  sem_post(&wakeup);
+  errno = err;
+}
+
+static void *trigger_loop(void *arg)
+{
+  struct timespec next;
+  int r;
+
+  block_signals();
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (!stopping) {
+    if (trigger_interval > 0) {
+      // the snapshots keep to the interval however long they take
+      next.tv_sec += (time_t)trigger_interval;
+      next.tv_nsec += (long)((trigger_interval - (time_t)trigger_interval) * 1e9);
+      if (next.tv_nsec >= 1000000000) {
+        next.tv_sec++;
+        next.tv_nsec -= 1000000000;
+      }
+      while (((r = sem_clockwait(&wakeup, CLOCK_MONOTONIC, &next)) < 0) && (errno == EINTR))
+        ;
+    }
+    else {
+      while (((r = sem_wait(&wakeup)) < 0) && (errno == EINTR))
+        ;
+    }
+    if (stopping) break;
+    take_fn();
+  }
+
+  return NULL;
+}
+
+int serve_trigger(int signo, double interval, void (*take)(void))
+{
+  struct sigaction sa;
+  int err;
+
+  if ((signo == 0) && (interval <= 0)) return 0;
+
+  sem_init(&wakeup, 0, 0);
+  trigger_interval = interval;
+  take_fn = take;
+  if ((err = pthread_create(&trigger, NULL, trigger_loop, NULL)) != 0) {
+    errno = err;
+    return -1;
+  }
+  pthread_detach(trigger);
+
+  if (signo != 0) {
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(signo, &sa, NULL) < 0) return -1;
+  }
+
+  return 0;
+}
+
+void serve_stop(void)
+{
+  if (take_fn != NULL) {
+    stopping = 1;
+    sem_post(&wakeup);
+  }
+  if (listen_fd < 0) return;
+
+  unlink(addr.sun_path);
+  shutdown(listen_fd, SHUT_RDWR);
+}
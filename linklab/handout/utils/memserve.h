@@ -0,0 +1,53 @@
+#ifndef __MEMSERVE_H__
+#define __MEMSERVE_H__
+
+//
+// serving the tracer's state while the program runs
+//
+// A background thread listens on a Unix domain socket and answers each
+// connection with a report, then closes it. The client sends nothing:
+// connecting is the request, and the report ends where the connection
+// does (tools/memsnap prints it). The thread blocks all signals, so
+// they keep going to the program's threads, and a client that hangs up
+// early makes the report's writes fail instead of raising SIGPIPE.
+//
+// Another thread, which blocks all signals as well, takes snapshots
+// when the program gets a signal or a timer expires. The handler of
+// the signal only wakes the thread, so taking a snapshot need not be
+// async-signal-safe.
+//
+
+//
+// create the socket and start the thread
+//
+//   path       socket path; a socket left there by an earlier run is
+//              replaced, anything else there is an error
+//   report     called on the thread for each connection with the
+//              connected socket, which it must not close
+//
+// returns
+//    int       0 on success, -1 on error (with errno set)
+//
+int serve_start(const char *path, void (*report)(int fd));
+
+//
+// start the thread taking snapshots
+//
+//   signo      signal that requests a snapshot, 0 for none; its handler
+//              replaces the program's
+//   interval   seconds between two snapshots, 0 for none
+//   take       called on the thread for each snapshot
+//
+// returns
+//    int       0 on success, -1 on error (with errno set)
+//
+int serve_trigger(int signo, double interval, void (*take)(void));
+
+//
+// stop accepting connections and remove the socket, and stop taking
+// snapshots; a report or snapshot being written goes on until it is
+// done or the program exits
+//
+void serve_stop(void);
+
+#endif
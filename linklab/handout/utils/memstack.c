@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "memstack.h"
+
+//
+// table geometry: the number of stacks it holds and the number of hash
+// slots, twice as many so that probe sequences stay short (powers of 2)
+//
+#define STACKS       (1 << 15)
+#define STACK_SLOTS  (2 * STACKS)
+
+//
+// the table: stacks[id] is the stack of id, and slots[] maps hashes to
+// ids (0 is empty). Lookups read it without a lock: a stack is written
+// before the slot that publishes it, and neither changes afterwards.
+//
+static stack *stacks = NULL;
+static unsigned int *slots = NULL;
+static unsigned int n_stacks = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+//
+// the bounds of the calling thread's stack; a frame pointer outside of
+// them ends the chain, so following it never reads unmapped memory
+//
+static __thread uintptr_t stack_lo __attribute__((tls_model("initial-exec"))) = 0;
+static __thread uintptr_t stack_hi __attribute__((tls_model("initial-exec"))) = 0;
+
+static void *map(size_t bytes)
+{
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "Error mapping %zu bytes for the stack table\n", bytes);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static void thread_bounds(void)
+{
+  pthread_attr_t attr;
+  void *addr;
+  size_t size;
+
+  // getting the main thread's bounds reads /proc and so allocates
+  if (pthread_getattr_np(pthread_self(), &attr) != 0) return;
+  if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+    stack_lo = (uintptr_t)addr;
+    stack_hi = (uintptr_t)addr + size;
+  }
+  pthread_attr_destroy(&attr);
+}
+
+//
+// follow the frame pointers from fp, the frame of the function that
+// wants its call site first
+//
+static int walk(void **frames, int max, uintptr_t fp)
+{
+  uintptr_t prev = 0;
+  int n = 0;
+
+  // a frame lies above the previous one, is aligned, and holds the
+  // caller's frame pointer followed by the return address
+  while ((n < max) && (fp > prev) && (fp % sizeof(void*) == 0) &&
+         (fp >= stack_lo) && (fp + 2 * sizeof(void*) <= stack_hi)) {
+    void *ret = ((void**)fp)[1];
+
+    if (ret == NULL) break;
+    frames[n++] = ret;
+    prev = fp;
+    fp = ((uintptr_t*)fp)[0];
+  }
+
+  return n;
+}
+
+int stack_capture(void **frames, int max, void *fp)
+{
+  void *bt[2 * STACK_MAX_DEPTH];
+  int i, n;
+
+  if (max > STACK_MAX_DEPTH) max = STACK_MAX_DEPTH;
+  if (stack_hi == 0) thread_bounds();
+
+  n = walk(frames, max, (uintptr_t)fp);
+  if ((n != 1) || (max == 1)) return n;
+
+  // the chain broke right after the call site: unwind the slow way, and
+  // drop the frames of the tracer that precede the call site
+  n = backtrace(bt, 2 * STACK_MAX_DEPTH);
+  for (i = 0; (i < n) && (bt[i] != frames[0]); i++)
+    ;
+  if (i == n) return 1;
+  n = (n - i < max) ? n - i : max;
+  memcpy(frames, bt + i, n * sizeof(void*));
+
+  return n;
+}
+
+static uint64_t hash(void **frames, int depth)
+{
+  uint64_t h = depth;
+  int i;
+
+  for (i = 0; i < depth; i++) {
+    h = (h ^ (uintptr_t)frames[i]) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+static int same(stack *s, uint64_t h, void **frames, int depth)
+{
+  return (s->hash == h) && (s->depth == (unsigned int)depth) &&
+         (memcmp(s->frames, frames, depth * sizeof(void*)) == 0);
+}
+
+//
+// the id of a stack, or 0 if it is not in the table
+//
+static unsigned int lookup(uint64_t h, void **frames, int depth, size_t *slot)
+{
+  size_t i = h & (STACK_SLOTS - 1);
+  unsigned int id;
+
+  while ((id = __atomic_load_n(&slots[i], __ATOMIC_ACQUIRE)) != 0) {
+    if (same(&stacks[id], h, frames, depth)) return id;
+    i = (i + 1) & (STACK_SLOTS - 1);
+  }
+  *slot = i;
+
+  return 0;
+}
+
+unsigned int stack_intern(void **frames, int depth)
+{
+  uint64_t h;
+  size_t slot;
+  unsigned int id;
+
+  if (depth > STACK_MAX_DEPTH) depth = STACK_MAX_DEPTH;
+  if (__atomic_load_n(&slots, __ATOMIC_ACQUIRE) == NULL) {
+    pthread_mutex_lock(&lock);
+    if (slots == NULL) {
+      stacks = map(STACKS * sizeof(stack));
+      n_stacks = 1;
+      __atomic_store_n(&slots, map(STACK_SLOTS * sizeof(unsigned int)), __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  h = hash(frames, depth);
+  if ((id = lookup(h, frames, depth, &slot)) != 0) return id;
+
+  // new stack: look again under the lock, another thread may have
+  // added it meanwhile
+  pthread_mutex_lock(&lock);
+  if (((id = lookup(h, frames, depth, &slot)) == 0) && (n_stacks < STACKS)) {
+    id = n_stacks;
+    stacks[id].hash = h;
+    stacks[id].depth = depth;
+    memcpy(stacks[id].frames, frames, depth * sizeof(void*));
+    __atomic_store_n(&n_stacks, id + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&slots[slot], id, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&lock);
+
+  return id;
+}
+
+void stack_account(unsigned int id, unsigned long allocs, unsigned long bytes)
+{
+  if (stacks == NULL) return;
+
+  __atomic_fetch_add(&stacks[id].allocs, allocs, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stacks[id].bytes, bytes, __ATOMIC_RELAXED);
+}
+
+unsigned int stack_count(void)
+{
+  return __atomic_load_n(&n_stacks, __ATOMIC_ACQUIRE);
+}
+
+const stack *stack_get(unsigned int id)
+{
+  return (id < stack_count()) ? &stacks[id] : NULL;
+}
+
+char *stack_symbol(void *addr, char *buf, size_t len)
+{
+  Dl_info info;
+  const char *module;
+
+  if (dladdr(addr, &info) == 0) {
+    snprintf(buf, len, "%p", addr);
+  }
+  else if (info.dli_sname != NULL) {
+    snprintf(buf, len, "%s+0x%tx", info.dli_sname, (char*)addr - (char*)info.dli_saddr);
+  }
+  else {
+    module = strrchr(info.dli_fname, '/');
+    snprintf(buf, len, "%s+0x%tx", module ? module + 1 : info.dli_fname,
+             (char*)addr - (char*)info.dli_fbase);
+  }
+
+  return buf;
+}
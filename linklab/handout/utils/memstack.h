@@ -0,0 +1,93 @@
+#ifndef __MEMSTACK_H__
+#define __MEMSTACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// call stacks of allocations
+//
+// A stack is captured by following the chain of saved frame pointers,
+// which costs a few loads per frame. Code built without frame pointers
+// breaks the chain; a stack that ends right after the call site is
+// captured again with glibc's backtrace(), which reads the unwind
+// tables and is much slower.
+//
+// Captured stacks are interned in a table that gives every distinct
+// stack a small id, so a block only needs to keep the id. The table
+// lives in memory obtained with mmap and holds a fixed number of
+// stacks; once it is full, new stacks get id 0, the unknown stack.
+// All functions may be called from any thread.
+//
+
+#define STACK_MAX_DEPTH 32
+
+//
+// an interned stack and the allocations made from it
+//
+//   depth      number of frames
+//   allocs     number of blocks allocated from the stack
+//   bytes      number of bytes allocated from the stack
+//   frames     return addresses, innermost (the call site) first
+//
+typedef struct __stack {
+  uint64_t hash;
+  unsigned int depth;
+  unsigned long allocs;
+  unsigned long bytes;
+  void *frames[STACK_MAX_DEPTH];
+} stack;
+
+//
+// capture a call stack
+//
+//   frames     array of at least max entries receiving the frames
+//   max        maximum number of frames, at most STACK_MAX_DEPTH
+//   fp         __builtin_frame_address(0) of the function whose call
+//              site is wanted first; it must keep a frame pointer
+//
+// returns
+//    int       number of frames captured
+//
+int stack_capture(void **frames, int max, void *fp);
+
+//
+// intern a stack
+//
+//   frames     return addresses, innermost first
+//   depth      number of frames
+//
+// returns
+//    unsigned  the id of the stack, or 0 if the table is full
+//
+unsigned int stack_intern(void **frames, int depth);
+
+//
+// add allocations to the counts of a stack
+//
+void stack_account(unsigned int id, unsigned long allocs, unsigned long bytes);
+
+//
+// number of ids handed out so far, the unknown stack 0 included
+//
+unsigned int stack_count(void);
+
+//
+// the stack of an id below stack_count()
+//
+const stack *stack_get(unsigned int id);
+
+//
+// name a frame as symbol+offset, or module+offset if the symbol is not
+// exported, or by its address
+//
+//   addr       return address
+//   buf        buffer receiving the name
+//   len        size of buf
+//
+// returns
+//    char*     buf
+//
+char *stack_symbol(void *addr, char *buf, size_t len);
+
+#endif